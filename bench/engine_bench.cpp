@@ -0,0 +1,371 @@
+// Copyright (c) 2024 DavidDeadly
+//
+// SkiaManager on the raster backend, fed through its input queue the way
+// the window feeds it, over scenes of synthetic pen strokes.
+#include <benchmark/benchmark.h>
+#include <cstdio>
+#include <vector>
+
+#include "drawing.h"
+#include "pen_traces.h"
+
+const int WIDTH = 1920;
+const int HEIGHT = 1080;
+const int TRACE_POINTS = 200;
+const char *DRAWING_PATH = "ipen_bench.ipen";
+
+static void drawTrace(IDrawingManager &drawingManager, InputQueue &queue,
+                      const std::vector<InputSample> &trace) {
+  for (const InputSample &sample : trace)
+    pushSample(queue, sample);
+
+  drawingManager.processInput(queue);
+}
+
+// A fresh manager holding a scene, with its first frame already displayed
+class Scene {
+public:
+  SkiaManager drawingManager;
+  InputQueue *queue = new InputQueue();
+  std::vector<std::vector<InputSample>> traces;
+
+  Scene(int strokes, int points) {
+    this->drawingManager.initRaster(WIDTH, HEIGHT);
+
+    PenTraceGenerator generator(WIDTH, HEIGHT, strokes * 31 + points);
+    for (int i = 0; i < strokes; i++)
+      this->traces.push_back(generator.stroke(points));
+
+    this->draw();
+  }
+
+  ~Scene() {
+    this->drawingManager.cleanUp();
+    delete this->queue;
+  }
+
+  void draw() {
+    for (const auto &trace : this->traces)
+      drawTrace(this->drawingManager, *this->queue, trace);
+
+    this->drawingManager.display(0);
+  }
+};
+
+// Points appended to a new stroke on top of a scene, the stroke is undone
+// after each trace so the scene keeps its size
+static void BM_DrawLineAppend(benchmark::State &state) {
+  Scene scene(state.range(0), TRACE_POINTS);
+  PenTraceGenerator generator(WIDTH, HEIGHT, 7);
+  std::vector<InputSample> trace = generator.stroke(TRACE_POINTS);
+
+  for (auto _ : state) {
+    for (const InputSample &sample : trace)
+      scene.drawingManager.drawLine(sample.isDown, sample.x, sample.y,
+                                    sample.pressure);
+
+    state.PauseTiming();
+    scene.drawingManager.undo();
+    scene.drawingManager.display(0);
+    state.ResumeTiming();
+  }
+
+  state.SetItemsProcessed(state.iterations() * trace.size());
+}
+
+// Erases every stroke of the scene in turn, pointing at one of its samples,
+// and draws the scene again once it is empty
+static void BM_EraseStroke(benchmark::State &state) {
+  Scene scene(state.range(0), state.range(1));
+  size_t next = 0;
+
+  for (auto _ : state) {
+    if (next == scene.traces.size()) {
+      state.PauseTiming();
+      scene.drawingManager.reset();
+      scene.draw();
+      next = 0;
+      state.ResumeTiming();
+    }
+
+    const std::vector<InputSample> &trace = scene.traces[next++];
+    const InputSample &target = trace[trace.size() / 2];
+    scene.drawingManager.eraseStroke(target.x, target.y);
+    scene.drawingManager.endErase();
+  }
+
+  state.SetItemsProcessed(state.iterations());
+}
+
+// Erasing a stroke and the frame repairing the tiles under it, the stroke
+// is put back after each one
+static void BM_EraseRepair(benchmark::State &state) {
+  Scene scene(state.range(0), TRACE_POINTS);
+  const std::vector<InputSample> &trace = scene.traces[0];
+  const InputSample &target = trace[trace.size() / 2];
+
+  for (auto _ : state) {
+    scene.drawingManager.eraseStroke(target.x, target.y);
+    scene.drawingManager.endErase();
+    scene.drawingManager.display(1);
+
+    state.PauseTiming();
+    scene.drawingManager.undo();
+    scene.drawingManager.display(1);
+    state.ResumeTiming();
+  }
+}
+
+// Sweeping the eraser across the middle of one long stroke in segment mode,
+// cutting it in two. Only the eraser events are timed, the frame repairing
+// the cut and undoing it after each one are not.
+static void BM_EraseSegments(benchmark::State &state) {
+  Scene scene(0, 0);
+  scene.drawingManager.setSimplifyTolerance(0);
+  scene.drawingManager.setEraserMode(ERASER_SEGMENTS);
+
+  PenTraceGenerator generator(WIDTH, HEIGHT, 19);
+  std::vector<InputSample> trace = generator.stroke(state.range(0));
+  for (const InputSample &sample : trace)
+    scene.drawingManager.drawLine(sample.isDown, sample.x, sample.y,
+                                  sample.pressure);
+  scene.drawingManager.display(1);
+
+  const InputSample &target = trace[trace.size() / 2];
+  for (auto _ : state) {
+    scene.drawingManager.eraseStroke(target.x - 4, target.y - 4);
+    scene.drawingManager.eraseStroke(target.x + 4, target.y + 4);
+    scene.drawingManager.endErase();
+
+    state.PauseTiming();
+    scene.drawingManager.display(1);
+    scene.drawingManager.undo();
+    scene.drawingManager.display(1);
+    state.ResumeTiming();
+  }
+
+  state.counters["points"] = scene.drawingManager.pointCount();
+}
+
+// Sweeping the pixel eraser across the middle of scenes of growing size and
+// the frame showing it, which should cost the same for all of them. The
+// mask is undone after each sweep.
+static void BM_ErasePixels(benchmark::State &state) {
+  Scene scene(state.range(0), TRACE_POINTS);
+  scene.drawingManager.setEraserMode(ERASER_PIXELS);
+
+  for (auto _ : state) {
+    scene.drawingManager.eraseStroke(WIDTH / 2 - 100, HEIGHT / 2);
+    scene.drawingManager.eraseStroke(WIDTH / 2 + 100, HEIGHT / 2);
+    scene.drawingManager.endErase();
+    scene.drawingManager.display(1);
+
+    state.PauseTiming();
+    scene.drawingManager.undo();
+    scene.drawingManager.display(1);
+    state.ResumeTiming();
+  }
+}
+
+// A frame while drawing: one more point of the live stroke and its repaint
+static void BM_DisplayDrawing(benchmark::State &state) {
+  Scene scene(state.range(0), TRACE_POINTS);
+  PenTraceGenerator generator(WIDTH, HEIGHT, 11);
+  std::vector<InputSample> trace = generator.stroke(TRACE_POINTS);
+  size_t next = 0;
+
+  for (auto _ : state) {
+    if (next == trace.size() - 1) {
+      state.PauseTiming();
+      scene.drawingManager.undo();
+      scene.drawingManager.display(1);
+      next = 0;
+      state.ResumeTiming();
+    }
+
+    const InputSample &sample = trace[next++];
+    scene.drawingManager.drawLine(true, sample.x, sample.y, sample.pressure);
+    scene.drawingManager.display(1);
+  }
+}
+
+// A frame repainting the whole window, as with a back buffer of unknown age
+static void BM_DisplayFull(benchmark::State &state) {
+  Scene scene(state.range(0), TRACE_POINTS);
+
+  for (auto _ : state) {
+    scene.drawingManager.addDamage(0, 0, WIDTH, HEIGHT);
+    scene.drawingManager.display(0);
+  }
+}
+
+// Undoing and redoing the last stroke, each followed by its frame since
+// that is where the layer gets repaired
+static void BM_UndoRedo(benchmark::State &state) {
+  Scene scene(state.range(0), TRACE_POINTS);
+
+  for (auto _ : state) {
+    scene.drawingManager.undo();
+    scene.drawingManager.display(1);
+    scene.drawingManager.redo();
+    scene.drawingManager.display(1);
+  }
+}
+
+// Undoing and redoing an erase deep in the history, none of it is walked
+static void BM_UndoRedoErase(benchmark::State &state) {
+  Scene scene(state.range(0), TRACE_POINTS);
+
+  const std::vector<InputSample> &trace = scene.traces[0];
+  const InputSample &target = trace[trace.size() / 2];
+  scene.drawingManager.eraseStroke(target.x, target.y);
+  scene.drawingManager.endErase();
+  scene.drawingManager.display(1);
+
+  for (auto _ : state) {
+    scene.drawingManager.undo();
+    scene.drawingManager.display(1);
+    scene.drawingManager.redo();
+    scene.drawingManager.display(1);
+  }
+}
+
+// Strokes drawn with a simplification tolerance, in tenths of a pixel, and
+// how many of their samples end up stored
+static void BM_Simplify(benchmark::State &state) {
+  Scene scene(0, TRACE_POINTS);
+  scene.drawingManager.setSimplifyTolerance(state.range(0) / 10.0f);
+
+  PenTraceGenerator generator(WIDTH, HEIGHT, 13);
+  std::vector<std::vector<InputSample>> traces;
+  size_t samples = 0;
+  for (int i = 0; i < 100; i++) {
+    traces.push_back(generator.stroke(TRACE_POINTS));
+    samples += traces.back().size();
+  }
+
+  size_t kept = 0;
+  for (auto _ : state) {
+    for (const auto &trace : traces)
+      drawTrace(scene.drawingManager, *scene.queue, trace);
+
+    state.PauseTiming();
+    kept = scene.drawingManager.pointCount();
+    scene.drawingManager.reset();
+    state.ResumeTiming();
+  }
+
+  state.counters["points_in"] = samples;
+  state.counters["points_kept"] = kept;
+  state.counters["reduction"] = 1 - (double)kept / samples;
+  state.SetItemsProcessed(state.iterations() * samples);
+}
+
+static void BM_SaveDrawing(benchmark::State &state) {
+  Scene scene(state.range(0), TRACE_POINTS);
+
+  for (auto _ : state)
+    scene.drawingManager.saveDrawing(DRAWING_PATH);
+
+  std::remove(DRAWING_PATH);
+  state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+
+// Opening a saved scene and the frames streaming it in
+static void BM_LoadDrawing(benchmark::State &state) {
+  Scene scene(state.range(0), TRACE_POINTS);
+  scene.drawingManager.saveDrawing(DRAWING_PATH);
+  scene.drawingManager.reset();
+  scene.drawingManager.display(0);
+
+  for (auto _ : state) {
+    scene.drawingManager.loadDrawing(DRAWING_PATH);
+    while (scene.drawingManager.needsRedraw())
+      scene.drawingManager.display(1);
+
+    state.PauseTiming();
+    scene.drawingManager.reset();
+    scene.drawingManager.display(1);
+    state.ResumeTiming();
+  }
+
+  std::remove(DRAWING_PATH);
+  state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+
+static void BM_Reset(benchmark::State &state) {
+  Scene scene(state.range(0), TRACE_POINTS);
+
+  for (auto _ : state) {
+    scene.drawingManager.reset();
+    scene.drawingManager.display(1);
+
+    state.PauseTiming();
+    scene.draw();
+    state.ResumeTiming();
+  }
+}
+
+BENCHMARK(BM_DrawLineAppend)
+    ->Arg(0)
+    ->Arg(1000)
+    ->Arg(10000)
+    ->Unit(benchmark::kMicrosecond);
+BENCHMARK(BM_EraseStroke)
+    ->ArgsProduct({{100, 1000, 10000}, {16, 128}})
+    ->Args({1000, 1024})
+    ->Unit(benchmark::kMicrosecond);
+BENCHMARK(BM_EraseRepair)
+    ->Arg(100)
+    ->Arg(1000)
+    ->Arg(10000)
+    ->Unit(benchmark::kMicrosecond);
+BENCHMARK(BM_EraseSegments)
+    ->Arg(1000)
+    ->Arg(10000)
+    ->Arg(50000)
+    ->Unit(benchmark::kMicrosecond);
+BENCHMARK(BM_ErasePixels)
+    ->Arg(100)
+    ->Arg(1000)
+    ->Arg(10000)
+    ->Unit(benchmark::kMicrosecond);
+BENCHMARK(BM_DisplayDrawing)
+    ->Arg(100)
+    ->Arg(1000)
+    ->Arg(10000)
+    ->Unit(benchmark::kMicrosecond);
+BENCHMARK(BM_DisplayFull)
+    ->Arg(100)
+    ->Arg(1000)
+    ->Arg(10000)
+    ->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_UndoRedo)
+    ->Arg(100)
+    ->Arg(1000)
+    ->Arg(10000)
+    ->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_UndoRedoErase)
+    ->Arg(100)
+    ->Arg(1000)
+    ->Arg(10000)
+    ->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_Simplify)
+    ->Arg(0)
+    ->Arg(5)
+    ->Arg(10)
+    ->Arg(20)
+    ->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_SaveDrawing)
+    ->Arg(1000)
+    ->Arg(10000)
+    ->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_LoadDrawing)
+    ->Arg(1000)
+    ->Arg(10000)
+    ->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_Reset)
+    ->Arg(100)
+    ->Arg(1000)
+    ->Arg(10000)
+    ->Unit(benchmark::kMillisecond);
@@ -0,0 +1,109 @@
+// Copyright (c) 2024 DavidDeadly
+//
+// Hit testing a point against every segment of one long stroke, missing so
+// the whole stroke is scanned:
+// - HitCurves: each segment's curve measured on its own, as the eraser did
+// - HitKernel: the curves flattened once into chords and scanned by each
+//   hit test kernel the CPU supports (0 scalar, 1 SSE2, 2 AVX2)
+// - SweptKernel: the same with the eraser moving across the screen, off it
+#include <benchmark/benchmark.h>
+#include <vector>
+
+#include "curves.h"
+#include "hit_test.h"
+#include "pen_traces.h"
+
+const int WIDTH = 1920;
+const int HEIGHT = 1080;
+const float HIT_RADIUS = 4;
+
+static std::vector<SkPoint> longStroke(int points) {
+  PenTraceGenerator generator(WIDTH, HEIGHT, 17);
+  std::vector<SkPoint> stroke;
+
+  for (const InputSample &sample : generator.stroke(points))
+    stroke.push_back(SkPoint::Make(sample.x, sample.y));
+
+  return stroke;
+}
+
+// off the screen, nothing is hit
+static const SkPoint MISS = SkPoint::Make(-100, -100);
+static const SkPoint MISS_END = SkPoint::Make(WIDTH + 100, -100);
+
+static HitSegments flatten(const std::vector<SkPoint> &stroke) {
+  uint32_t length = stroke.size();
+  HitSegments segments;
+
+  for (uint32_t segment = 1; segment < length; segment++)
+    segments.addCurve(strokeCurve(stroke.data(), length, segment),
+                      HIT_RADIUS, segment);
+
+  return segments;
+}
+
+static void BM_HitCurves(benchmark::State &state) {
+  std::vector<SkPoint> stroke = longStroke(state.range(0));
+  uint32_t length = stroke.size();
+
+  for (auto _ : state) {
+    bool isHit = false;
+    for (uint32_t segment = 1; segment < length && !isHit; segment++) {
+      StrokeCurve curve = strokeCurve(stroke.data(), length, segment);
+      isHit = distanceToCurveSquared(curve, MISS) <= HIT_RADIUS * HIT_RADIUS;
+    }
+
+    benchmark::DoNotOptimize(isHit);
+  }
+
+  state.SetItemsProcessed(state.iterations() * (length - 1));
+}
+
+static void BM_HitKernel(benchmark::State &state) {
+  HitKernel kernel = (HitKernel)state.range(1);
+  if (!isHitKernelSupported(kernel)) {
+    state.SkipWithError("kernel not supported by this CPU");
+    return;
+  }
+
+  std::vector<SkPoint> stroke = longStroke(state.range(0));
+  uint32_t length = stroke.size();
+
+  HitSegments segments = flatten(stroke);
+
+  for (auto _ : state)
+    benchmark::DoNotOptimize(firstHit(segments, MISS, 0, kernel));
+
+  state.counters["chords"] = segments.size();
+  state.SetItemsProcessed(state.iterations() * (length - 1));
+}
+
+static void BM_SweptKernel(benchmark::State &state) {
+  HitKernel kernel = (HitKernel)state.range(1);
+  if (!isHitKernelSupported(kernel)) {
+    state.SkipWithError("kernel not supported by this CPU");
+    return;
+  }
+
+  std::vector<SkPoint> stroke = longStroke(state.range(0));
+  uint32_t length = stroke.size();
+  HitSegments segments = flatten(stroke);
+
+  for (auto _ : state)
+    benchmark::DoNotOptimize(
+        firstSweptHit(segments, MISS, MISS_END, 0, kernel));
+
+  state.counters["chords"] = segments.size();
+  state.SetItemsProcessed(state.iterations() * (length - 1));
+}
+
+BENCHMARK(BM_HitCurves)
+    ->Arg(10000)
+    ->Arg(100000)
+    ->Unit(benchmark::kMicrosecond);
+BENCHMARK(BM_HitKernel)
+    ->ArgsProduct({{10000, 100000}, {HIT_SCALAR, HIT_SSE2, HIT_AVX2}})
+    ->Unit(benchmark::kMicrosecond);
+BENCHMARK(BM_SweptKernel)
+    ->ArgsProduct({{10000, 100000}, {HIT_SCALAR, HIT_SSE2, HIT_AVX2}})
+    ->Unit(benchmark::kMicrosecond);
@@ -0,0 +1,39 @@
+// Copyright (c) 2024 DavidDeadly
+//
+// Runs the benchmarks with the usual console report, and always keeps a
+// JSON copy of the results (ipen_bench.json unless --benchmark_out is given)
+// so runs can be compared over time.
+#include <benchmark/benchmark.h>
+#include <cstring>
+#include <vector>
+
+#include "log.h"
+
+int main(int argc, char **argv) {
+  std::vector<char *> arguments(argv, argv + argc);
+
+  bool hasOutput = false;
+  for (int i = 1; i < argc; i++)
+    if (strncmp(argv[i], "--benchmark_out=", 16) == 0)
+      hasOutput = true;
+
+  char defaultOutput[] = "--benchmark_out=ipen_bench.json";
+  char defaultFormat[] = "--benchmark_out_format=json";
+  if (!hasOutput) {
+    arguments.push_back(defaultOutput);
+    arguments.push_back(defaultFormat);
+  }
+
+  int count = arguments.size();
+  arguments.push_back(nullptr);
+  benchmark::Initialize(&count, arguments.data());
+  if (benchmark::ReportUnrecognizedArguments(count, arguments.data()))
+    return 1;
+
+  // keep the engine's messages out of the report
+  setLogLevel(LOG_LEVEL_ERROR);
+
+  benchmark::RunSpecifiedBenchmarks();
+  benchmark::Shutdown();
+  return 0;
+}
@@ -0,0 +1,63 @@
+// Copyright (c) 2024 DavidDeadly
+#include "pen_traces.h"
+
+#include <algorithm>
+#include <cmath>
+
+const float AVERAGE_SPEED = 4; // pixels between samples
+const float MAX_TURN = 0.08f;  // radians of curvature per sample
+const float JITTER = 0.3f;     // pixels of sensor noise
+
+PenTraceGenerator::PenTraceGenerator(int width, int height, uint32_t seed)
+    : random(seed) {
+  this->width = width;
+  this->height = height;
+}
+
+std::vector<InputSample> PenTraceGenerator::stroke(int points) {
+  std::uniform_real_distribution<float> x(0, this->width);
+  std::uniform_real_distribution<float> y(0, this->height);
+  std::uniform_real_distribution<float> angle(0, 2 * M_PI);
+  std::uniform_real_distribution<float> turn(-MAX_TURN, MAX_TURN);
+  std::normal_distribution<float> jitter(0, JITTER);
+
+  float positionX = x(this->random);
+  float positionY = y(this->random);
+  float heading = angle(this->random);
+  float curvature = 0;
+
+  std::vector<InputSample> samples;
+  samples.reserve(points + 1);
+
+  for (int i = 0; i < points; i++) {
+    float progress = points > 1 ? (float)i / (points - 1) : 0;
+
+    // speed follows the bell of a minimum-jerk hand movement, which
+    // averages to 1 over the stroke, and pressure follows the touch
+    float speed = AVERAGE_SPEED * 30 * progress * progress * (1 - progress) *
+                  (1 - progress);
+    float pressure = std::sqrt(std::sin(progress * M_PI)) * 0.9f + 0.1f;
+
+    InputSample sample = {};
+    sample.x = std::clamp(positionX + jitter(this->random), 0.0f,
+                          (float)this->width);
+    sample.y = std::clamp(positionY + jitter(this->random), 0.0f,
+                          (float)this->height);
+    sample.pressure = std::clamp(pressure, 0.0f, 1.0f);
+    sample.tool = TOOL_PEN;
+    sample.isDown = true;
+    samples.push_back(sample);
+
+    curvature = std::clamp(curvature + turn(this->random) / 4, -MAX_TURN,
+                           MAX_TURN);
+    heading += curvature;
+    positionX += std::cos(heading) * std::max(speed, 0.5f);
+    positionY += std::sin(heading) * std::max(speed, 0.5f);
+  }
+
+  InputSample lift = samples.back();
+  lift.isDown = false;
+  samples.push_back(lift);
+
+  return samples;
+}
@@ -0,0 +1,25 @@
+// Copyright (c) 2024 DavidDeadly
+#pragma once
+
+#include <cstdint>
+#include <random>
+#include <vector>
+
+#include "input.h"
+
+// Synthetic strokes shaped like the ones a pen reports: smooth curves whose
+// speed builds up and fades out, pressure rising at touch down and easing
+// off at lift, and a bit of sensor jitter. Seeded, so every run of a
+// benchmark draws the same scene.
+class PenTraceGenerator {
+private:
+  std::mt19937 random;
+  int width;
+  int height;
+
+public:
+  PenTraceGenerator(int width, int height, uint32_t seed);
+
+  // Samples of one stroke, pen down for every point and up at the end
+  std::vector<InputSample> stroke(int points);
+};
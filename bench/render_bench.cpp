@@ -0,0 +1,163 @@
+// Copyright (c) 2024 DavidDeadly
+//
+// Frame cost of the ways strokes can get their soft edge, over scenes of
+// 100, 1000 and 10000 strokes drawn on a CPU raster surface:
+// - BlurEveryFrame: every stroke redrawn with a blur mask filter each frame
+// - BakedLayer: the blurred strokes cached in a layer, a frame composites it
+//   plus the sharp live stroke
+// - Repair*: repainting a damaged region of the layer, blurring each stroke
+//   as the layer does, so it matches how they were baked, or the region
+//   once, which darkens translucent strokes
+#include <benchmark/benchmark.h>
+
+#include "include/core/SkBlendMode.h"
+#include "include/core/SkBlurTypes.h"
+#include "include/core/SkCanvas.h"
+#include "include/core/SkImageInfo.h"
+#include "include/core/SkMaskFilter.h"
+#include "include/core/SkSurface.h"
+#include "include/effects/SkImageFilters.h"
+
+#include "pen_traces.h"
+#include "strokes.h"
+
+const int WIDTH = 1920;
+const int HEIGHT = 1080;
+const int POINTS_PER_STROKE = 64;
+const float BLUR_SIGMA = 1;
+
+static SkPaint sharpPaint() {
+  SkPaint paint;
+  paint.setColor(SK_ColorRED);
+  paint.setAntiAlias(true);
+  paint.setStyle(SkPaint::kFill_Style);
+
+  return paint;
+}
+
+static SkPaint blurredPaint() {
+  SkPaint paint = sharpPaint();
+  paint.setMaskFilter(
+      SkMaskFilter::MakeBlur(SkBlurStyle::kSolid_SkBlurStyle, BLUR_SIGMA));
+
+  return paint;
+}
+
+static void buildScene(StrokeStore &store, int count) {
+  PenTraceGenerator generator(WIDTH, HEIGHT, count);
+  uint16_t style = store.addStyle(sharpPaint());
+
+  for (int i = 0; i < count; i++) {
+    StrokeId stroke = store.create(style);
+
+    for (const InputSample &sample : generator.stroke(POINTS_PER_STROKE))
+      if (sample.isDown)
+        store.append(stroke, SkPoint::Make(sample.x, sample.y),
+                     4 * sample.pressure);
+  }
+}
+
+static sk_sp<SkSurface> makeSurface() {
+  return SkSurfaces::Raster(SkImageInfo::MakeN32Premul(WIDTH, HEIGHT));
+}
+
+static void BM_BlurEveryFrame(benchmark::State &state) {
+  StrokeStore store;
+  buildScene(store, state.range(0));
+
+  sk_sp<SkSurface> surface = makeSurface();
+  SkCanvas *canvas = surface->getCanvas();
+  SkPaint paint = blurredPaint();
+
+  for (auto _ : state) {
+    canvas->clear(SK_ColorTRANSPARENT);
+    for (int stroke = 0; stroke < state.range(0); stroke++)
+      canvas->drawPath(store.outline(stroke), paint);
+  }
+}
+
+static void BM_BakedLayer(benchmark::State &state) {
+  StrokeStore store;
+  buildScene(store, state.range(0));
+
+  sk_sp<SkSurface> surface = makeSurface();
+  sk_sp<SkSurface> layer = makeSurface();
+  SkPaint paint = blurredPaint();
+
+  StrokeId live = state.range(0) - 1;
+  for (StrokeId stroke = 0; stroke < live; stroke++)
+    layer->getCanvas()->drawPath(store.outline(stroke), paint);
+
+  SkPaint replace;
+  replace.setBlendMode(SkBlendMode::kSrc);
+  SkPaint livePaint = sharpPaint();
+
+  for (auto _ : state) {
+    SkCanvas *canvas = surface->getCanvas();
+    layer->draw(canvas, 0, 0, SkSamplingOptions(), &replace);
+    canvas->drawPath(store.outline(live), livePaint);
+  }
+}
+
+static void repairRegion(benchmark::State &state, bool isBlurredOnce) {
+  StrokeStore store;
+  buildScene(store, state.range(0));
+
+  sk_sp<SkSurface> layer = makeSurface();
+  SkCanvas *canvas = layer->getCanvas();
+  SkRect damage = SkRect::MakeXYWH(WIDTH / 2 - 128, HEIGHT / 2 - 128, 256, 256);
+
+  SkPaint soften;
+  soften.setImageFilter(SkImageFilters::Merge(
+      SkImageFilters::Blur(BLUR_SIGMA, BLUR_SIGMA, nullptr), nullptr));
+  SkPaint paint = isBlurredOnce ? sharpPaint() : blurredPaint();
+
+  for (auto _ : state) {
+    canvas->save();
+    canvas->clipRect(damage);
+    canvas->clear(SK_ColorTRANSPARENT);
+
+    SkRect reach = damage.makeOutset(3, 3);
+    if (isBlurredOnce)
+      canvas->saveLayer(&reach, &soften);
+
+    for (StrokeId stroke = 0; stroke < state.range(0); stroke++) {
+      SkRect bounds = store.boundsOf(stroke).makeOutset(3, 3);
+      if (SkRect::Intersects(bounds, reach))
+        canvas->drawPath(store.outline(stroke), paint);
+    }
+
+    if (isBlurredOnce)
+      canvas->restore();
+    canvas->restore();
+  }
+}
+
+static void BM_RepairPerStrokeBlur(benchmark::State &state) {
+  repairRegion(state, false);
+}
+
+static void BM_RepairLayerBlur(benchmark::State &state) {
+  repairRegion(state, true);
+}
+
+BENCHMARK(BM_BlurEveryFrame)
+    ->Arg(100)
+    ->Arg(1000)
+    ->Arg(10000)
+    ->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_BakedLayer)
+    ->Arg(100)
+    ->Arg(1000)
+    ->Arg(10000)
+    ->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_RepairPerStrokeBlur)
+    ->Arg(100)
+    ->Arg(1000)
+    ->Arg(10000)
+    ->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_RepairLayerBlur)
+    ->Arg(100)
+    ->Arg(1000)
+    ->Arg(10000)
+    ->Unit(benchmark::kMillisecond);
@@ -0,0 +1,31 @@
+// Copyright (c) 2024 DavidDeadly
+#include "buffer_age.h"
+
+#include <GL/glx.h>
+#include <GL/glxext.h>
+#include <cstring>
+
+static bool hasBufferAge(Display *display) {
+  const char *extensions =
+      glXQueryExtensionsString(display, DefaultScreen(display));
+
+  return extensions != NULL &&
+         strstr(extensions, "GLX_EXT_buffer_age") != NULL;
+}
+
+int queryBufferAge() {
+  Display *display = glXGetCurrentDisplay();
+  GLXDrawable drawable = glXGetCurrentDrawable();
+
+  if (display == NULL || drawable == None)
+    return 0;
+
+  static bool isSupported = hasBufferAge(display);
+  if (!isSupported)
+    return 0;
+
+  unsigned int age = 0;
+  glXQueryDrawable(display, drawable, GLX_BACK_BUFFER_AGE_EXT, &age);
+
+  return age;
+}
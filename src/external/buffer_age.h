@@ -0,0 +1,6 @@
+// Copyright (c) 2024 DavidDeadly
+#pragma once
+
+// Number of frames since the current back buffer was presented, or 0 when
+// its contents are unknown (no GLX_EXT_buffer_age, EGL, ...)
+int queryBufferAge();
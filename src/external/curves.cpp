@@ -0,0 +1,104 @@
+// Copyright (c) 2024 DavidDeadly
+#include "curves.h"
+
+#include <algorithm>
+#include <limits>
+
+// Direction of a vector scaled to a length, none for an empty one
+static SkVector handle(SkVector direction, float length) {
+  if (!direction.normalize())
+    return SkVector::Make(0, 0);
+
+  return direction * length;
+}
+
+StrokeCurve strokeCurve(const SkPoint *points, uint32_t length,
+                        uint32_t segment) {
+  SkPoint start = points[segment - 1];
+  SkPoint end = points[segment];
+  SkPoint before = segment >= 2 ? points[segment - 2] : start;
+  SkPoint after = segment + 1 < length ? points[segment + 1] : end;
+
+  float handleLength = SkPoint::Distance(start, end) / 3;
+
+  return {start, start + handle(end - before, handleLength),
+          end - handle(after - start, handleLength), end};
+}
+
+static SkPoint midpoint(const SkPoint &a, const SkPoint &b) {
+  return SkPoint::Make((a.fX + b.fX) / 2, (a.fY + b.fY) / 2);
+}
+
+// de Casteljau at the middle of the curve
+void splitCurve(const StrokeCurve &curve, StrokeCurve &first,
+                StrokeCurve &second) {
+  SkPoint startHandle = midpoint(curve.start, curve.control1);
+  SkPoint middleHandle = midpoint(curve.control1, curve.control2);
+  SkPoint endHandle = midpoint(curve.control2, curve.end);
+  SkPoint firstControl = midpoint(startHandle, middleHandle);
+  SkPoint secondControl = midpoint(middleHandle, endHandle);
+  SkPoint middle = midpoint(firstControl, secondControl);
+
+  first = {curve.start, startHandle, firstControl, middle};
+  second = {middle, secondControl, endHandle, curve.end};
+}
+
+SkPoint curvePoint(const StrokeCurve &curve, float t) {
+  float u = 1 - t;
+  float a = u * u * u;
+  float b = 3 * u * u * t;
+  float c = 3 * u * t * t;
+  float d = t * t * t;
+
+  return SkPoint::Make(a * curve.start.fX + b * curve.control1.fX +
+                           c * curve.control2.fX + d * curve.end.fX,
+                       a * curve.start.fY + b * curve.control1.fY +
+                           c * curve.control2.fY + d * curve.end.fY);
+}
+
+// Utility function to calculate the squared distance from a point to a line
+// segment, so callers can compare against a squared radius without sqrt
+static float distanceToSegmentSquared(const SkPoint &lineStart,
+                                      const SkPoint &lineEnd,
+                                      const SkPoint &point) {
+  // Compute the vector from the line's start to end point
+  SkVector lineDirection = lineEnd - lineStart;
+  SkVector pointToStart = point - lineStart;
+
+  // Compute the projection of the point onto the line segment
+  float lengthSquared = lineDirection.dot(lineDirection);
+  float scaleFactor = 0;
+  if (lengthSquared > 0)
+    scaleFactor = pointToStart.dot(lineDirection) / lengthSquared;
+
+  // Clamp the projection to the segment range [0, 1]
+  scaleFactor = std::clamp(scaleFactor, 0.0f, 1.0f);
+
+  // Calculate the closest point on the segment using the correct operation
+  float dx = lineStart.fX + scaleFactor * lineDirection.fX - point.fX;
+  float dy = lineStart.fY + scaleFactor * lineDirection.fY - point.fY;
+
+  return dx * dx + dy * dy;
+}
+
+// A straight segment is its own chord
+bool isStraight(const StrokeCurve &curve) {
+  return curve.control1 == curve.start && curve.control2 == curve.end;
+}
+
+float distanceToCurveSquared(const StrokeCurve &curve, const SkPoint &point) {
+  if (isStraight(curve))
+    return distanceToSegmentSquared(curve.start, curve.end, point);
+
+  float distance = std::numeric_limits<float>::max();
+  SkPoint chordStart = curve.start;
+
+  for (int chord = 1; chord <= CURVE_CHORDS; chord++) {
+    SkPoint chordEnd = curvePoint(curve, (float)chord / CURVE_CHORDS);
+    distance = std::min(distance,
+                        distanceToSegmentSquared(chordStart, chordEnd, point));
+    chordStart = chordEnd;
+  }
+
+  return distance;
+}
@@ -0,0 +1,33 @@
+// Copyright (c) 2024 DavidDeadly
+#pragma once
+
+#include <cstdint>
+
+#include "include/core/SkPoint.h"
+
+const int CURVE_CHORDS = 8; // a curve is measured over
+
+// Cubic Bezier drawn for one segment of a stroke
+struct StrokeCurve {
+  SkPoint start;
+  SkPoint control1;
+  SkPoint control2;
+  SkPoint end;
+};
+
+// Catmull-Rom through the points of a stroke, from points[segment - 1] to
+// points[segment]. The tangent at a point follows its neighbours, with
+// handles a third of the segment long so uneven spacing can't make the
+// curve overshoot, and the ends of the stroke go straight. The curve stays
+// within a third of its length from the segment.
+StrokeCurve strokeCurve(const SkPoint *points, uint32_t length,
+                        uint32_t segment);
+
+void splitCurve(const StrokeCurve &curve, StrokeCurve &first,
+                StrokeCurve &second);
+SkPoint curvePoint(const StrokeCurve &curve, float t);
+bool isStraight(const StrokeCurve &curve);
+
+// Squared distance from a point to the curve, measured over a few chords of
+// it so callers can compare against a squared radius without sqrt
+float distanceToCurveSquared(const StrokeCurve &curve, const SkPoint &point);
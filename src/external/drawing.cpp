@@ -3,133 +3,753 @@
 #include "include/core/SkPaint.h"
 #include <cstddef>
 
-#define SK_GANESH
-#define SK_GL // For GrContext::MakeGL
-#include <GLFW/glfw3.h>
 #include <algorithm>
-#include <iostream>
+#include <cmath>
+#include <thread>
 
+#include "include/core/SkBlendMode.h"
 #include "include/core/SkBlurTypes.h"
 #include "include/core/SkCanvas.h"
-#include "include/core/SkColorSpace.h"
+#include "include/core/SkImageInfo.h"
 #include "include/core/SkMaskFilter.h"
-#include "include/gpu/ganesh/GrBackendSurface.h"
-#include "include/gpu/ganesh/SkSurfaceGanesh.h"
-#include "include/gpu/ganesh/gl/GrGLAssembleInterface.h"
-#include "include/gpu/ganesh/gl/GrGLBackendSurface.h"
-#include "include/gpu/ganesh/gl/GrGLDirectContext.h"
 
-void SkiaManager::init(int width, int height) {
+#include "curves.h"
+#include "hit_test.h"
+#include "journal.h"
+#include "log.h"
+#include "simplify.h"
+
+const int GRID_CELL_SIZE = 32;
+const size_t INPUT_BATCH_SIZE = 256;
+
+const float STROKE_WIDTH = 4;
+const float MIN_PRESSURE = 0.2f;
+const float BLUR_SIGMA = 1;
+const float BLUR_MARGIN = 3; // reach of the blur
+const float ERASER_PADDING = 2; // TODO: make it configurable
+const float PIXEL_ERASER_RADIUS = 12;
+
+// Full pressure, and so the mouse, draws at the stroke width
+static float widthFor(float pressure) {
+  return STROKE_WIDTH * std::clamp(pressure, MIN_PRESSURE, 1.0f);
+}
+
+// Everything drawn on top of the target surface, whichever backend made it
+void SkiaManager::initLayers() {
+  // a GPU context can't be shared by threads, raster tiles are repaired on
+  // every core
+  if (!this->context) {
+    unsigned cores = std::max(1u, std::thread::hardware_concurrency());
+    this->tilePool = new WorkerPool(cores - 1);
+  }
+
+  this->layer.init(this->surface, this->width, this->height, this->tilePool);
+
+  this->grid.init(this->width, this->height, GRID_CELL_SIZE);
+  this->addDamage(0, 0, this->width, this->height);
+}
+
+// CPU backend drawing into memory, for running without a GPU or a display
+void SkiaManager::initRaster(int width, int height) {
   this->width = width;
   this->height = height;
 
-  auto interface = GrGLMakeNativeInterface();
-  if (interface == nullptr) {
-    // backup plan. see
-    // https://gist.github.com/ad8e/dd150b775ae6aa4d5cf1a092e4713add?permalink_comment_id=4680136#gistcomment-4680136
-    interface = GrGLMakeAssembledInterface(
-        nullptr, (GrGLGetProc) * [](void *, const char *p) -> void * {
-          return (void *)glfwGetProcAddress(p);
-        });
-  }
-
-  this->context = GrDirectContexts::MakeGL(interface).release();
-
-  GrGLFramebufferInfo framebufferInfo;
-  framebufferInfo.fFBOID = 0; // assume default framebuffer
-
-  // We are always using OpenGL and we use RGBA8 internal format for both RGBA
-  // and BGRA configs in OpenGL.
-  //(replace line below with this one to enable correct color spaces)
-  // framebufferInfo.fFormat = GL_SRGB8_ALPHA8;
-  framebufferInfo.fFormat = GL_RGBA8;
-
-  SkColorType colorType = kRGBA_8888_SkColorType;
-  GrBackendRenderTarget backendRenderTarget =
-      GrBackendRenderTargets::MakeGL(width, height,
-                                     0, // sample count
-                                     0, // stencil bits
-                                     framebufferInfo);
-
-  //(replace line below with this one to enable correct color spaces)
-  // sSurface= SkSurfaces::WrapBackendRenderTarget(sContext,
-  // backendRenderTarget, kBottomLeft_GrSurfaceOrigin, colorType,
-  // SkColorSpace::MakeSRGB(), nullptr).release();
-  this->surface = SkSurfaces::WrapBackendRenderTarget(
-                      context, backendRenderTarget, kBottomLeft_GrSurfaceOrigin,
-                      colorType, nullptr, nullptr)
-                      .release();
-
+  SkImageInfo info = SkImageInfo::MakeN32Premul(width, height);
+  this->surface = SkSurfaces::Raster(info).release();
   if (this->surface == nullptr)
     abort();
+
+  this->initLayers();
+}
+
+sk_sp<SkImage> SkiaManager::snapshot() {
+  return this->surface->makeImageSnapshot();
 }
 
 void SkiaManager::cleanUp() {
+  delete journal;
+  delete pendingJournal;
+  delete drawingReader;
+  layer.cleanUp();
+  delete tilePool;
   delete surface;
   delete context;
 }
 
-SkPaint *SkiaManager::generatePaint() {
-  bool samePaint = this->currentPaint->getColor() == this->currentColor;
-  if (samePaint)
-    return this->currentPaint;
+SkPaint SkiaManager::generatePaint(SkColor color) {
+  SkPaint paint;
+
+  paint.setColor(color);
+
+  // strokes are filled outlines already following the pen's width, the soft
+  // edge is only added once they are baked into the layer
+  paint.setAntiAlias(true);
+  paint.setStyle(SkPaint::kFill_Style);
+
+  return paint;
+}
+
+// Strokes of the same color share one paint of the store's table
+uint16_t SkiaManager::styleFor(SkColor color) {
+  int style = this->strokes.findStyle(color);
+  if (style >= 0)
+    return style;
 
-  SkPaint *paint = new SkPaint();
+  return this->strokes.addStyle(this->generatePaint(color));
+}
+
+// The stroke still being drawn is always the last visible one and is kept
+// out of the layer until the pen lifts
+void SkiaManager::finishStroke() {
+  StrokeId stroke = this->currentStroke;
+  this->currentStroke = NO_STROKE;
+
+  if (stroke == NO_STROKE)
+    return;
+
+  if (this->hasPendingPoint)
+    this->addPoint(stroke, this->pendingPoint, this->pendingWidth);
+  this->hasPendingPoint = false;
 
-  paint->setColor(this->currentColor);
+  // the baked stroke replaces what was drawn of it live, simplified and
+  // with its soft edge. The curve through fewer points can bulge past
+  // where the live one went, both are repainted.
+  this->damage.join(this->strokeBounds(stroke));
+  this->simplify(stroke);
+  this->damage.join(this->strokeBounds(stroke));
+  this->layer.add(stroke, this->tileBounds(stroke));
+  this->bakeStroke(stroke);
+
+  this->history.record({COMMAND_ADD, stroke});
+}
+
+// Once the pen lifts the whole stroke is known, so the points the radial
+// filter kept while drawing are simplified again over all of it
+void SkiaManager::simplify(StrokeId stroke) {
+  if (this->simplifyTolerance <= 0)
+    return;
 
-  paint->setAntiAlias(true);
-  paint->setStrokeWidth(4);
-  paint->setStyle(SkPaint::kStroke_Style);
-  paint->setStrokeCap(SkPaint::kRound_Cap);
-  paint->setStrokeJoin(SkPaint::kRound_Join);
+  uint32_t length = this->strokes.length(stroke);
+  const SkPoint *points = this->strokes.pointsOf(stroke);
+  const float *widths = this->strokes.widthsOf(stroke);
 
-  paint->setMaskFilter(
-      SkMaskFilter::MakeBlur(SkBlurStyle::kSolid_SkBlurStyle, 1));
+  std::vector<SkPoint> simplified(points, points + length);
+  std::vector<float> simplifiedWidths(widths, widths + length);
+  uint32_t kept = simplifyStroke(simplified.data(), simplifiedWidths.data(),
+                                  length, this->simplifyTolerance);
+  if (kept == length)
+    return;
+
+  this->grid.removeStroke(stroke, points, widths, length, ERASER_PADDING);
+  this->strokes.rewrite(stroke, simplified.data(), simplifiedWidths.data(),
+                        kept);
+  this->grid.insertStroke(stroke, this->strokes.pointsOf(stroke),
+                          this->strokes.widthsOf(stroke), kept,
+                          ERASER_PADDING);
+
+  LOG_DEBUG("drawing", "Simplified stroke from %u to %u points", length,
+            kept);
+}
+
+void SkiaManager::setSimplifyTolerance(float tolerance) {
+  this->simplifyTolerance = tolerance;
+}
+
+void SkiaManager::setHistoryBudget(size_t bytes) {
+  this->history.setBudget(bytes);
+}
+
+size_t SkiaManager::pointCount() {
+  size_t count = 0;
+  for (const auto stroke : this->visibleStrokes)
+    count += this->strokes.length(stroke);
+
+  return count;
+}
+
+// The live stroke's outline comes in two parts, one of them extended in
+// place. A translucent stroke goes through a layer so it is composited once
+// as a whole, instead of darker where the parts overlap.
+void SkiaManager::drawLiveStroke(SkCanvas *canvas) {
+  StrokeId live = this->currentStroke;
+  if (live == NO_STROKE)
+    return;
+
+  SkPaint paint = this->strokes.paint(live);
+  U8CPU alpha = paint.getAlpha();
+  paint.setAlpha(0xFF);
+
+  bool isTranslucent = alpha < 0xFF;
+  if (isTranslucent) {
+    SkRect bounds = this->strokes.boundsOf(live);
+    canvas->saveLayerAlpha(&bounds, alpha);
+  }
+
+  canvas->drawPath(this->strokes.growingOutline(live), paint);
+  canvas->drawPath(this->strokes.lastSegmentOutline(live), paint);
+
+  if (isTranslucent)
+    canvas->restore();
+}
+
+// The stroke being drawn is only antialiased, blurring its mask on every
+// frame costs more than the rest of it, so the soft edge is rasterized once
+// here when the stroke is done
+void SkiaManager::bakeStroke(StrokeId stroke) {
+  SkPaint paint = this->bakedPaint(stroke);
+  const SkPath &outline = this->strokes.outline(stroke);
+  this->layer.draw(this->strokeBounds(stroke),
+                   [&outline, &paint](SkCanvas *canvas) {
+                     canvas->drawPath(outline, paint);
+                   });
+}
+
+// The stroke's shape over its own halo, the same whether it is baked or
+// repaired
+SkPaint SkiaManager::bakedPaint(StrokeId stroke) {
+  SkPaint paint = this->strokes.paint(stroke);
+  paint.setMaskFilter(
+      SkMaskFilter::MakeBlur(SkBlurStyle::kSolid_SkBlurStyle, BLUR_SIGMA));
 
-  delete this->currentPaint;
   return paint;
 }
 
-void SkiaManager::display() {
+SkRect SkiaManager::strokeBounds(StrokeId stroke) {
+  return this->strokes.boundsOf(stroke).makeOutset(BLUR_MARGIN, BLUR_MARGIN);
+}
+
+// Strokes are listed in the tiles they blur into and in those whose repair
+// reaches them
+SkRect SkiaManager::tileBounds(StrokeId stroke) {
+  return this->strokeBounds(stroke).makeOutset(BLUR_MARGIN, BLUR_MARGIN);
+}
+
+void SkiaManager::addDamage(float left, float top, float right,
+                            float bottom) {
+  this->damage.join(SkRect::MakeLTRB(left, top, right, bottom));
+}
+
+void SkiaManager::invalidateLayer(StrokeId stroke) {
+  SkRect bounds = this->strokeBounds(stroke);
+
+  this->layer.invalidate(bounds);
+  this->damage.join(bounds);
+}
+
+void SkiaManager::repairLayer() {
+  if (!this->layer.isDamaged())
+    return;
+
+  this->layer.repair([this](LayerTile &tile) { this->repairTile(tile); });
+}
+
+// Repaints only the damaged area of a tile with the strokes crossing it,
+// each with the paint it was baked with, so a repaired area can't be told
+// apart from the strokes around it, translucent ones included. Runs on the
+// tile pool's threads, so it only reads the strokes.
+void SkiaManager::repairTile(LayerTile &tile) {
+  SkCanvas *tileCanvas = tile.surface->getCanvas();
+
+  tileCanvas->save();
+  tileCanvas->translate(-tile.bounds.left(), -tile.bounds.top());
+  tileCanvas->clipRect(tile.damage);
+  tileCanvas->clear(SK_ColorTRANSPARENT);
+
+  // strokes right outside the damage still blur into it
+  SkRect reach = tile.damage.makeOutset(BLUR_MARGIN, BLUR_MARGIN);
+
+  // masks erase the strokes stacked under them as they come, sharp over
+  // the baked strokes like painting or loading them did
+  size_t nextMask = 0;
+  auto eraseUntil = [&](StrokeId stroke) {
+    for (; nextMask < tile.masks.size(); nextMask++) {
+      const TileMask &mask = tile.masks[nextMask];
+      if (stroke != NO_STROKE && !this->layer.isBelow(mask.mask, stroke))
+        break;
+
+      LayerTiles::applyMask(tileCanvas, tile, mask.surface);
+    }
+  };
+
+  SkPath outline;
+  for (const auto stroke : tile.strokes) {
+    if (!SkRect::Intersects(this->strokeBounds(stroke), reach))
+      continue;
+
+    eraseUntil(stroke);
+    this->strokes.buildOutline(stroke, outline);
+    tileCanvas->drawPath(outline, this->bakedPaint(stroke));
+  }
+  eraseUntil(NO_STROKE);
+
+  tileCanvas->restore();
+}
+
+// Area of the back buffer that is out of date: the damage of every frame
+// presented since it was last drawn, or all of it when its age is unknown
+SkRect SkiaManager::repaintRegion(int bufferAge) {
+  SkRect frameDamage = this->damage;
+  this->damage.setEmpty();
+
+  SkRect region = frameDamage;
+  bool isReusable = bufferAge > 0 && bufferAge <= DAMAGE_HISTORY;
+
+  for (int age = 1; isReusable && age < bufferAge; age++) {
+    int frame = (this->lastFrame - age + 1 + DAMAGE_HISTORY) % DAMAGE_HISTORY;
+    region.join(this->damageHistory[frame]);
+  }
+
+  this->lastFrame = (this->lastFrame + 1) % DAMAGE_HISTORY;
+  this->damageHistory[this->lastFrame] = frameDamage;
+
+  if (!isReusable)
+    return SkRect::MakeWH(this->width, this->height);
+
+  return region;
+}
+
+void SkiaManager::display(int bufferAge) {
+  this->loadBlock();
+  this->repairLayer();
+
+  SkRect region = this->repaintRegion(bufferAge);
+  if (region.isEmpty())
+    return;
+
   SkCanvas *canvas = this->surface->getCanvas();
-  canvas->clear(SK_ColorTRANSPARENT);
 
-  for (const auto iPath : this->iPaths)
-    canvas->drawPath(*iPath->path, iPath->paint);
+  // a rect clip becomes a scissor in Ganesh, and copying the layer with kSrc
+  // replaces the stale pixels without clearing them first
+  canvas->save();
+  canvas->clipRect(region);
+
+  SkPaint replace;
+  replace.setBlendMode(SkBlendMode::kSrc);
+  this->layer.composite(canvas, region, &replace);
+
+  this->drawLiveStroke(canvas);
+
+  canvas->restore();
 
-  this->context->flush();
+  if (this->context)
+    this->context->flush();
 }
 
-void SkiaManager::drawLine(bool isDrawing, double xpos, double ypos) {
-  bool isNotDrawing = !isDrawing;
-  if (isNotDrawing) {
-    this->currentPath = NULL;
+bool SkiaManager::needsRedraw() {
+  return !this->damage.isEmpty() || this->drawingReader;
+}
+
+// Strokes still being loaded are saved too, the rest of the file is read
+// first
+bool SkiaManager::saveDrawing(const char *path) {
+  this->finishStroke();
+  this->finishErase();
+  while (this->drawingReader)
+    this->loadBlock();
+
+  if (!this->journal)
+    return saveStrokes(path, this->strokes, this->visibleStrokes,
+                       this->savedMasks());
+
+  // saved as a compaction, so the journal is emptied along with it
+  uint64_t sequence = this->journal->lastSequence();
+  this->journal->compact(path,
+                         encodeStrokes(this->strokes, this->visibleStrokes,
+                                       this->savedMasks(), sequence));
+
+  return this->journal->flush();
+}
+
+// The journal goes on top of the whole drawing, so while it is still
+// loading the journal waits for its last block. Operations after the ones
+// the drawing includes are replayed, then new ones are appended.
+bool SkiaManager::openJournal(const char *drawingPath) {
+  std::string path = std::string(drawingPath) + ".journal";
+  Journal *journal = new Journal(path.c_str());
+  if (!journal->isOpen()) {
+    delete journal;
+    return false;
+  }
+
+  this->journalDrawing = drawingPath;
+  if (this->drawingReader) {
+    delete this->pendingJournal;
+    this->pendingJournal = journal;
+    return true;
+  }
+
+  this->replayJournal(journal);
+  return true;
+}
+
+void SkiaManager::replayJournal(Journal *journal) {
+  uint64_t lastSequence = journal->replay(
+      this->drawingSequence,
+      [this](const JournalRecord &record) { this->replayOp(record); });
+
+  // a stroke or an erase the crash cut short
+  this->finishStroke();
+  this->finishErase();
+
+  journal->start(lastSequence);
+  this->journal = journal;
+}
+
+// An operation made before the journal is replayed would go under its
+// records, the rest of the drawing is loaded and the journal replayed first
+void SkiaManager::awaitJournal() {
+  if (!this->pendingJournal)
+    return;
+
+  while (this->drawingReader)
+    this->loadBlock();
+}
+
+void SkiaManager::journalOp(JournalOp op, float x, float y, float pressure) {
+  if (this->journal)
+    this->journal->append(op, x, y, pressure, this->currentColor);
+}
+
+void SkiaManager::replayOp(const JournalRecord &record) {
+  switch (record.op) {
+  case JOURNAL_BEGIN:
+    // snapshots don't keep the color in use, each stroke brings its own.
+    // Not a change to undo, the session never recorded one.
+    this->currentColor = record.color;
+    this->replayedStroke =
+        this->beginStroke(record.x, record.y, record.pressure);
+    break;
+  case JOURNAL_POINT:
+    this->appendPoint(this->replayedStroke, record.x, record.y,
+                      record.pressure);
+    break;
+  case JOURNAL_END:
+    this->endStroke(this->replayedStroke);
+    break;
+  case JOURNAL_CANCEL:
+    this->cancelStroke(this->replayedStroke);
+    break;
+  case JOURNAL_ERASE:
+    this->setEraserMode((EraserMode)record.pressure);
+    this->eraseStroke(record.x, record.y);
+    break;
+  case JOURNAL_ERASE_END:
+    this->endErase();
+    break;
+  case JOURNAL_UNDO:
+    this->undo();
+    break;
+  case JOURNAL_REDO:
+    this->redo();
+    break;
+  case JOURNAL_RESET:
+    this->reset();
+    break;
+  case JOURNAL_COLOR:
+    this->setColor(record.color);
+    break;
+  }
+}
+
+// Snapshots are only taken between strokes and erases, neither the live
+// stroke nor where the eraser is are saved. Recovery loads a snapshot with
+// nothing to undo, so the session can't undo past it either.
+void SkiaManager::compactJournal() {
+  bool isDue = this->journal && this->currentStroke == NO_STROKE &&
+               !this->isErasing &&
+               this->journal->recordsSinceCompaction() >=
+                   this->journalCompactRecords;
+  if (!isDue)
+    return;
+
+  uint64_t sequence = this->journal->lastSequence();
+  this->journal->compact(this->journalDrawing.c_str(),
+                         encodeStrokes(this->strokes, this->visibleStrokes,
+                                       this->savedMasks(), sequence));
+  this->history.clear();
+}
+
+void SkiaManager::setJournalCompaction(uint64_t records) {
+  this->journalCompactRecords = records;
+}
+
+// Each mask is saved over the visible strokes stacked under it
+std::vector<MaskPixels> SkiaManager::savedMasks() {
+  std::vector<MaskPixels> saved(this->visibleMasks.size());
+  std::vector<StrokeId> &visible = this->visibleStrokes;
+  uint32_t position = 0;
+
+  for (size_t i = 0; i < saved.size(); i++) {
+    MaskId mask = this->visibleMasks[i];
+    while (position < visible.size() &&
+           !this->layer.isBelow(mask, visible[position]))
+      position++;
+
+    saved[i].position = position;
+    this->layer.readMask(mask, saved[i].tiles, saved[i].coverage);
+  }
+
+  return saved;
+}
+
+// Loaded strokes go on top of the current ones, streamed in over the next
+// frames so a large drawing doesn't hold the window up
+bool SkiaManager::loadDrawing(const char *path) {
+  this->awaitJournal();
+
+  StrokeFileReader *reader = new StrokeFileReader(path);
+  if (!reader->isOpen()) {
+    delete reader;
+    return false;
+  }
+
+  delete this->drawingReader;
+  this->drawingReader = reader;
+  this->drawingSequence = reader->journalSequence();
+
+  this->finishStroke();
+  this->finishErase();
+  this->history.clear();
+
+  LOG_INFO("drawing", "Loading %u strokes", reader->strokeCount());
+  return true;
+}
+
+void SkiaManager::loadBlock() {
+  if (!this->drawingReader)
+    return;
+
+  StrokeBatch &batch = this->loadedBatch;
+  if (!this->drawingReader->next(batch)) {
+    delete this->drawingReader;
+    this->drawingReader = nullptr;
+
+    Journal *journal = this->pendingJournal;
+    this->pendingJournal = nullptr;
+    if (journal)
+      this->replayJournal(journal);
+    return;
+  }
+
+  if (batch.isMask) {
+    this->loadMask(batch.mask);
     return;
   }
 
+  // the live stroke stays the last visible one
+  StrokeId live = this->currentStroke;
+  if (live != NO_STROKE)
+    this->visibleStrokes.pop_back();
+
+  size_t offset = 0;
+  for (size_t i = 0; i < batch.lengths.size(); i++) {
+    uint32_t length = batch.lengths[i];
+    const SkPoint *points = batch.points.data() + offset;
+    const float *widths = batch.widths.data() + offset;
+    offset += length;
+
+    if (length == 0)
+      continue;
+
+    StrokeId stroke = this->strokes.create(this->styleFor(batch.colors[i]));
+    for (uint32_t point = 0; point < length; point++)
+      this->strokes.append(stroke, points[point], widths[point]);
+
+    this->grid.insertStroke(stroke, this->strokes.pointsOf(stroke),
+                            this->strokes.widthsOf(stroke), length,
+                            ERASER_PADDING);
+    this->visibleStrokes.push_back(stroke);
+    this->layer.add(stroke, this->tileBounds(stroke));
+    this->bakeStroke(stroke);
+    this->damage.join(this->strokeBounds(stroke));
+  }
+
+  if (live != NO_STROKE)
+    this->visibleStrokes.push_back(live);
+}
+
+// Stacked over the strokes loaded so far and erased from them right away
+void SkiaManager::loadMask(const MaskPixels &pixels) {
+  MaskId mask = this->layer.addMask();
+
+  const uint8_t *coverage = pixels.coverage.data();
+  for (const auto &rect : pixels.tiles) {
+    this->layer.writeMask(mask, rect, coverage);
+    coverage += (size_t)rect.width() * rect.height();
+  }
+
+  this->visibleMasks.push_back(mask);
+  this->damage.join(this->layer.maskBounds(mask));
+}
+
+void SkiaManager::applySample(const InputSample &sample) {
+  // the system cursor follows the pen too, drop it while a tablet is near
+  if (sample.isTablet)
+    this->isTabletNear = sample.tool != TOOL_NONE;
+  else if (this->isTabletNear)
+    return;
+
+  bool isErasing = sample.tool == TOOL_ERASER && sample.isDown;
+  if (isErasing) {
+    this->eraseStroke(sample.x, sample.y);
+    return;
+  }
+
+  this->endErase();
+
+  bool isDrawing = sample.tool == TOOL_PEN && sample.isDown;
+  this->drawLine(isDrawing, sample.x, sample.y, sample.pressure);
+}
+
+// Drains the samples queued since the last frame, stopping at a partial
+// batch so a fast producer can't keep the frame from finishing
+uint64_t SkiaManager::processInput(InputQueue &queue) {
+  InputSample batch[INPUT_BATCH_SIZE];
+  size_t count;
+  uint64_t oldest = 0;
+
+  do {
+    count = queue.popBatch(batch, INPUT_BATCH_SIZE);
+    if (oldest == 0 && count > 0)
+      oldest = batch[0].timestamp;
+
+    for (size_t i = 0; i < count; i++)
+      this->applySample(batch[i]);
+  } while (count == INPUT_BATCH_SIZE);
+
+  this->compactJournal();
+  return oldest;
+}
+
+bool SkiaManager::isLive(StrokeHandle stroke) {
+  return stroke.id == this->currentStroke && this->strokes.isCurrent(stroke);
+}
+
+StrokeHandle SkiaManager::beginStroke(double xpos, double ypos,
+                                      float pressure) {
+  this->awaitJournal();
+  this->journalOp(JOURNAL_BEGIN, xpos, ypos, pressure);
+  this->finishStroke();
+  this->finishErase();
+
   double clampedX = std::clamp(xpos, 0.0, (double)this->width);
   double clampedY = std::clamp(ypos, 0.0, (double)this->height);
 
-  bool hasPath = std::find_if(this->iPaths.begin(), this->iPaths.end(),
-                              [this](const auto &iPath) {
-                                return iPath->path == this->currentPath;
-                              }) != this->iPaths.end();
+  uint16_t style = this->styleFor(this->currentColor);
+  this->currentStroke = this->strokes.create(style);
+  this->strokes.append(this->currentStroke, SkPoint::Make(clampedX, clampedY),
+                       widthFor(pressure));
+  this->visibleStrokes.push_back(this->currentStroke);
+
+  StrokeHandle stroke = this->strokes.handle(this->currentStroke);
+  this->extendStroke(stroke.id, xpos, ypos, pressure);
 
-  if (!hasPath) {
-    this->clearRedoStack();
+  return stroke;
+}
+
+bool SkiaManager::appendPoint(StrokeHandle handle, double xpos, double ypos,
+                              float pressure) {
+  if (!this->isLive(handle))
+    return false;
 
-    this->currentPaint = this->generatePaint();
-    this->currentPath = new SkPath();
-    this->currentPath->moveTo(clampedX, clampedY);
+  this->journalOp(JOURNAL_POINT, xpos, ypos, pressure);
+  this->extendStroke(handle.id, xpos, ypos, pressure);
+
+  return true;
+}
 
-    auto path = new SkiaPath(this->currentPath, *this->currentPaint);
-    this->iPaths.push_back(path);
+void SkiaManager::extendStroke(StrokeId stroke, double xpos, double ypos,
+                               float pressure) {
+  double clampedX = std::clamp(xpos, 0.0, (double)this->width);
+  double clampedY = std::clamp(ypos, 0.0, (double)this->height);
+  SkPoint point = SkPoint::Make(clampedX, clampedY);
+
+  uint32_t length = this->strokes.length(stroke);
+  SkPoint lastPoint = this->strokes.pointsOf(stroke)[length - 1];
+  float lastWidth = this->strokes.widthsOf(stroke)[length - 1];
+  float width = widthFor(pressure);
+
+  // radial filter: samples too close to the last point kept add nothing the
+  // tolerance would show
+  float tolerance = this->simplifyTolerance;
+  bool isRedundant = SkPoint::Distance(lastPoint, point) < tolerance &&
+                     std::abs(width - lastWidth) / 2 < tolerance;
+
+  this->hasPendingPoint = isRedundant;
+  if (isRedundant) {
+    this->pendingPoint = point;
+    this->pendingWidth = width;
+  } else {
+    this->addPoint(stroke, point, width);
   }
 
-  this->currentPath->lineTo(clampedX, clampedY);
-  std::cout << "Drawing with cursor at: " << clampedX << ", " << clampedY
-            << std::endl;
+  LOG_DEBUG("drawing", "Drawing with cursor at: %.1f, %.1f", clampedX,
+            clampedY);
+}
+
+// The new segment is damaged along with the one before it, whose curve
+// bends now that the point after it is known
+void SkiaManager::addPoint(StrokeId stroke, SkPoint point, float width) {
+  uint32_t segment = this->strokes.length(stroke);
+  uint32_t first = segment > 1 ? segment - 2 : segment - 1;
+
+  this->strokes.append(stroke, point, width);
+
+  const SkPoint *points = this->strokes.pointsOf(stroke);
+  const float *widths = this->strokes.widthsOf(stroke);
+  this->grid.insertSegment(stroke, points, widths, segment, ERASER_PADDING);
+
+  SkRect bounds;
+  bounds.setBounds(points + first, segment - first + 1);
+
+  // curves stray up to a third of their length from their points
+  float margin = 0;
+  for (uint32_t i = first + 1; i <= segment; i++)
+    margin = std::max(margin, SkPoint::Distance(points[i - 1], points[i]) / 3 +
+                                  std::max(widths[i - 1], widths[i]) / 2);
+
+  margin += BLUR_MARGIN;
+  this->damage.join(bounds.makeOutset(margin, margin));
+}
+
+void SkiaManager::endStroke(StrokeHandle stroke) {
+  if (!this->isLive(stroke))
+    return;
+
+  this->journalOp(JOURNAL_END);
+  this->finishStroke();
+}
+
+void SkiaManager::cancelStroke(StrokeHandle handle) {
+  if (!this->isLive(handle))
+    return;
+
+  this->journalOp(JOURNAL_CANCEL);
+
+  StrokeId stroke = handle.id;
+  this->currentStroke = NO_STROKE;
+  this->damage.join(this->strokeBounds(stroke));
+
+  this->grid.removeStroke(stroke, this->strokes.pointsOf(stroke),
+                          this->strokes.widthsOf(stroke),
+                          this->strokes.length(stroke), ERASER_PADDING);
+  this->visibleStrokes.pop_back();
+  this->strokes.release(stroke);
+}
+
+void SkiaManager::drawLine(bool isDrawing, double xpos, double ypos,
+                           float pressure) {
+  bool isNotDrawing = !isDrawing;
+  if (isNotDrawing) {
+    this->endStroke(this->cursorStroke);
+    return;
+  }
+
+  // a stroke removed while drawing (undo, erase) makes the cursor start over
+  bool isAppended =
+      this->appendPoint(this->cursorStroke, xpos, ypos, pressure);
+  if (!isAppended)
+    this->cursorStroke = this->beginStroke(xpos, ypos, pressure);
 }
 
 SkColor rbgaToSkColor(float rgba[4]) {
@@ -141,24 +761,34 @@ SkColor rbgaToSkColor(float rgba[4]) {
   return SkColorSetARGB(alpha, red, green, blue);
 }
 
+// Colors picked one after another are a single step to undo
+void SkiaManager::setColor(SkColor color) {
+  if (this->currentColor == color)
+    return;
+
+  this->awaitJournal();
+  this->finishErase();
+  this->history.recordColor(this->currentColor, color);
+  this->currentColor = color;
+  this->journalOp(JOURNAL_COLOR);
+}
+
 void SkiaManager::changeColor(float rgba[4]) {
   SkColor skColor = rbgaToSkColor(rgba);
 
   if (this->currentColor == skColor)
     return;
 
-  this->currentColor = skColor;
-  std::cout << "SkiaManager - Changing color from UI to: " << &rgba
-            << std::endl;
+  this->setColor(skColor);
+  LOG_DEBUG("drawing", "Changing color from UI to: #%08X", skColor);
 }
 
 void SkiaManager::changeColor(float rgba[4], Color color) {
-  std::cout << "SkiaManager - Changing color to: " << color << std::endl;
+  LOG_DEBUG("drawing", "Changing color to: %d", color);
 
   std::array<float, 4> rgbaColor = this->colors[color];
-  std::cout << "rgbaColor: " << rgbaColor.data() << std::endl;
   if (rgbaColor.size() != 4) {
-    std::cerr << "Invalid color: " << color << std::endl;
+    LOG_ERROR("drawing", "Invalid color: %d", color);
     return;
   }
 
@@ -170,132 +800,503 @@ void SkiaManager::changeColor(float rgba[4], Color color) {
   rgba[2] = nextColor[2];
   rgba[3] = nextColor[3];
 
-  std::cout << "SkiaManager - Color changed to: " << rgbaColor.data()
-            << std::endl;
-  this->currentColor = skColor;
+  LOG_DEBUG("drawing", "Color changed to: #%08X", skColor);
+  this->setColor(skColor);
+}
+
+void SkiaManager::readColor(float rgba[4]) {
+  rgba[0] = SkColorGetR(this->currentColor) / 255.0f;
+  rgba[1] = SkColorGetG(this->currentColor) / 255.0f;
+  rgba[2] = SkColorGetB(this->currentColor) / 255.0f;
+  rgba[3] = SkColorGetA(this->currentColor) / 255.0f;
 }
 
+// Cleared strokes are kept by the reset, so it can be undone
 void SkiaManager::reset() {
+  this->awaitJournal();
+  this->journalOp(JOURNAL_RESET);
+
+  delete this->drawingReader;
+  this->drawingReader = nullptr;
+
+  this->finishStroke();
+  this->finishErase();
   this->surface->getCanvas()->clear(SK_ColorTRANSPARENT);
 
-  for (auto iPath : this->iPaths) {
-    delete iPath;
+  Command command = {COMMAND_RESET, NO_STROKE, this->history.takePayload()};
+  this->apply(command);
+  this->history.record(command);
+}
+
+// The eraser sweeps a capsule from its last position, so a fast flick
+// still erases everything it went over. The curves along it are flattened
+// into one batch of chords for the swept hit test kernel, and every stroke
+// with a chord hit is erased.
+void SkiaManager::eraseStroke(double xpos, double ypos) {
+  this->awaitJournal();
+  SkPoint position = SkPoint::Make(xpos, ypos);
+  SkPoint from = this->isErasing ? this->eraserPosition : position;
+  this->isErasing = true;
+  this->eraserPosition = position;
+
+  // every sample is kept, replaying them sweeps over the same strokes
+  this->journalOp(JOURNAL_ERASE, xpos, ypos, this->eraserMode);
+
+  if (this->eraserMode == ERASER_PIXELS) {
+    this->erasePixels(from, position);
+    return;
   }
 
-  this->iPaths.clear();
-}
+  // simplifying renumbers the segments of the live stroke, it is finished
+  // before any can be cut
+  if (this->eraserMode == ERASER_SEGMENTS)
+    this->finishStroke();
 
-// Utility function to calculate the distance from a point to a line segment
-static float distanceToSegment(const SkPoint &lineStart, const SkPoint &lineEnd,
-                               const SkPoint &point) {
-  // Compute the vector from the line's start to end point
-  SkVector lineDirection = lineEnd - lineStart;
-  SkVector pointToStart = point - lineStart;
+  std::vector<GridEntry> &candidates = this->eraserCandidates;
+  candidates.clear();
+  this->grid.candidatesAlong(from, position, candidates);
 
-  // Compute the projection of the point onto the line segment
-  float scaleFactor =
-      pointToStart.dot(lineDirection) / lineDirection.dot(lineDirection);
+  HitSegments &segments = this->hitSegments;
+  segments.clear();
 
-  // Clamp the projection to the segment range [0, 1]
-  float MIN = 0;
-  float MAX = 1;
-  scaleFactor = std::max(MIN, std::min(MAX, scaleFactor));
+  for (uint32_t i = 0; i < candidates.size(); i++) {
+    const GridEntry &candidate = candidates[i];
+    const SkPoint *points = this->strokes.pointsOf(candidate.stroke);
+    const float *widths = this->strokes.widthsOf(candidate.stroke);
+    StrokeCurve curve = strokeCurve(
+        points, this->strokes.length(candidate.stroke), candidate.segment);
 
-  // Calculate the closest point on the segment using the correct operation
-  float closestPointX = lineStart.fX + scaleFactor * lineDirection.fX;
-  float closestPointY = lineStart.fY + scaleFactor * lineDirection.fY;
-  SkPoint closestPoint = SkPoint::Make(closestPointX, closestPointY);
+    float width = std::max(widths[candidate.segment - 1],
+                           widths[candidate.segment]);
+    segments.addCurve(curve, width / 2 + ERASER_PADDING, i);
+  }
 
-  // Manually calculate the distance between the point and the projection
-  float dx = closestPoint.fX - point.fX;
-  float dy = closestPoint.fY - point.fY;
+  std::vector<GridEntry> &hits = this->eraserHits;
+  hits.clear();
 
-  // Euclidean distance
-  float distance = std::pow(dx, 2) + std::pow(dy, 2);
-  return std::sqrt(distance);
+  size_t hit = firstSweptHit(segments, from, position, 0);
+  while (hit != NO_HIT) {
+    hits.push_back(candidates[segments.owners[hit]]);
+    hit = firstSweptHit(segments, from, position, hit + 1);
+  }
+
+  // each stroke's segments together and in order, some of them twice as
+  // they are listed in every cell they cross
+  std::sort(hits.begin(), hits.end(),
+            [](const GridEntry &a, const GridEntry &b) {
+              return a.stroke != b.stroke ? a.stroke < b.stroke
+                                          : a.segment < b.segment;
+            });
+
+  size_t erased = 0;
+  for (size_t begin = 0, end; begin < hits.size(); begin = end) {
+    StrokeId stroke = hits[begin].stroke;
+    for (end = begin + 1; end < hits.size(); end++)
+      if (hits[end].stroke != stroke)
+        break;
+
+    if (this->eraserMode == ERASER_SEGMENTS) {
+      this->cut(stroke, &hits[begin], end - begin);
+    } else {
+      if (stroke == this->currentStroke)
+        this->finishStroke();
+      this->erase(stroke);
+    }
+    erased++;
+  }
+
+  if (erased > 0)
+    LOG_DEBUG("drawing", "Erased from %zu strokes at: %.1f, %.1f", erased,
+              xpos, ypos);
 }
 
-static bool isPointNearPath(SkiaPath *iPath, const SkPoint &point) {
-  SkPath::Verb verb;
-  SkPath::Iter iter(*iPath->path, false);
-  SkPoint currentPoint, lastPoint;
+// Erased strokes are hidden right away but only recorded as one step to
+// undo once the eraser lifts
+void SkiaManager::erase(StrokeId stroke) {
+  if (this->erasePayload == NO_PAYLOAD)
+    this->erasePayload = this->history.takePayload();
 
-  float strokeWidth = iPath->paint.getStrokeWidth();
-  float simetricalStrokeWidth = strokeWidth / 2.0f;
-  const float ERASER_HIT_BOX =
-      simetricalStrokeWidth + 2.0f; // TODO: make it configurable
+  CommandPayload &erased = this->history.payload(this->erasePayload);
+  std::vector<StrokeId> &visible = this->visibleStrokes;
+  auto position = std::find(visible.begin(), visible.end(), stroke);
 
-  bool firstSegment = true;
-  while ((verb = iter.next(&currentPoint)) != SkPath::kDone_Verb) {
-    if (verb != SkPath::kLine_Verb)
-      continue;
+  erased.strokes.push_back(stroke);
+  erased.positions.push_back(position - visible.begin());
 
-    if (firstSegment) {
-      firstSegment = false;
-      continue;
+  visible.erase(position);
+  this->hideStroke(stroke);
+}
+
+// The pixels under the eraser go from the layer as it paints a mask over
+// it, so erasing costs the same however many strokes are under it
+void SkiaManager::erasePixels(SkPoint from, SkPoint to) {
+  if (this->eraseMask == NO_MASK) {
+    // the live stroke goes under the mask too
+    this->finishStroke();
+    this->eraseMask = this->layer.addMask();
+    this->visibleMasks.push_back(this->eraseMask);
+  }
+
+  SkPaint paint;
+  paint.setAntiAlias(true);
+  paint.setStyle(SkPaint::kStroke_Style);
+  paint.setStrokeWidth(2 * PIXEL_ERASER_RADIUS);
+  paint.setStrokeCap(SkPaint::kRound_Cap);
+
+  SkPoint ends[2] = {from, to};
+  SkRect bounds;
+  bounds.setBounds(ends, 2);
+  bounds.outset(PIXEL_ERASER_RADIUS + 1, PIXEL_ERASER_RADIUS + 1);
+
+  this->layer.paintMask(this->eraseMask, bounds,
+                        [&](SkCanvas *canvas, SkBlendMode mode) {
+                          paint.setBlendMode(mode);
+                          canvas->drawLine(from, to, paint);
+                        });
+  this->damage.join(bounds);
+}
+
+// The segments hit are cut out of the stroke, the runs of them left on
+// either side become pieces over its points
+void SkiaManager::cut(StrokeId stroke, const GridEntry *hits, size_t count) {
+  if (this->erasePayload == NO_PAYLOAD)
+    this->erasePayload = this->history.takePayload();
+
+  CommandPayload &split = this->history.payload(this->erasePayload);
+  size_t firstPiece = split.pieces.size();
+  uint32_t length = this->strokes.length(stroke);
+  uint32_t first = 0;
+
+  // a segment joins the point before it to its own, a run of points
+  // ends right before the next segment cut
+  for (size_t i = 0; i <= count; i++) {
+    uint32_t end = i < count ? hits[i].segment : length;
+    if (end - first >= 2) {
+      StrokeId piece = this->strokes.split(stroke, first, end - first);
+      split.pieces.push_back({piece, first, end - first});
     }
 
-    float distance = distanceToSegment(lastPoint, currentPoint, point);
-    if (distance <= ERASER_HIT_BOX)
-      return true;
+    first = end;
+  }
+
+  std::vector<StrokeId> &visible = this->visibleStrokes;
+  uint32_t position =
+      std::find(visible.begin(), visible.end(), stroke) - visible.begin();
+  uint32_t pieceCount = split.pieces.size() - firstPiece;
+
+  split.strokes.push_back(stroke);
+  split.positions.push_back(position);
+  split.pieceCounts.push_back(pieceCount);
+  this->splitStroke(stroke, position, split.pieces.data() + firstPiece,
+                    pieceCount);
+}
+
+// The pieces take the stroke's place, in the list and in the tiles, and
+// draw the same as it did but around the cut, which is all that is
+// repainted
+void SkiaManager::splitStroke(StrokeId stroke, uint32_t position,
+                              const StrokePiece *pieces, uint32_t count) {
+  std::vector<StrokeId> &visible = this->visibleStrokes;
+  if (position < visible.size() && visible[position] == stroke)
+    visible.erase(visible.begin() + position);
+  else
+    std::erase(visible, stroke);
+
+  size_t at = std::min<size_t>(position, visible.size());
+  for (uint32_t i = 0; i < count; i++)
+    visible.insert(visible.begin() + at + i, pieces[i].stroke);
+
+  SkRect bounds = this->strokes.boundsOf(stroke).makeOutset(ERASER_PADDING,
+                                                            ERASER_PADDING);
+  this->grid.splitStroke(stroke, bounds, pieces, count);
+
+  this->layer.remove(stroke, this->tileBounds(stroke));
+  for (uint32_t i = 0; i < count; i++)
+    this->layer.insertAt(pieces[i].stroke, this->tileBounds(pieces[i].stroke),
+                         stroke);
+
+  SkRect cut = this->cutBounds(stroke, pieces, count);
+  this->layer.invalidate(cut);
+  this->damage.join(cut);
+}
+
+void SkiaManager::joinStroke(StrokeId stroke, uint32_t position,
+                             const StrokePiece *pieces, uint32_t count) {
+  std::vector<StrokeId> &visible = this->visibleStrokes;
+  bool isInPlace = position + count <= visible.size();
+  for (uint32_t i = 0; i < count && isInPlace; i++)
+    isInPlace = visible[position + i] == pieces[i].stroke;
+
+  if (isInPlace)
+    visible.erase(visible.begin() + position,
+                  visible.begin() + position + count);
+  else
+    for (uint32_t i = 0; i < count; i++)
+      std::erase(visible, pieces[i].stroke);
+
+  size_t at = std::min<size_t>(position, visible.size());
+  visible.insert(visible.begin() + at, stroke);
+
+  this->grid.joinStroke(stroke, this->strokes.pointsOf(stroke),
+                        this->strokes.widthsOf(stroke),
+                        this->strokes.length(stroke), ERASER_PADDING, pieces,
+                        count);
+
+  for (uint32_t i = 0; i < count; i++)
+    this->layer.remove(pieces[i].stroke, this->tileBounds(pieces[i].stroke));
+  this->layer.insert(stroke, this->tileBounds(stroke));
+
+  SkRect cut = this->cutBounds(stroke, pieces, count);
+  this->layer.invalidate(cut);
+  this->damage.join(cut);
+}
+
+// The segments cut out, and the ones next to them whose curves bent towards
+// the points that went
+SkRect SkiaManager::cutBounds(StrokeId stroke, const StrokePiece *pieces,
+                              uint32_t count) {
+  uint32_t length = this->strokes.length(stroke);
+  SkRect bounds = SkRect::MakeEmpty();
+
+  uint32_t next = 1;
+  for (uint32_t i = 0; i <= count; i++) {
+    uint32_t last = i < count ? pieces[i].first : length - 1;
+
+    if (next <= last) {
+      uint32_t from = std::max(next, 2u) - 1;
+      uint32_t to = std::min(last + 1, length - 1);
+      for (uint32_t segment = from; segment <= to; segment++)
+        bounds.join(this->strokes.boundsOfSegment(stroke, segment));
+    }
 
-    lastPoint = currentPoint;
+    if (i < count)
+      next = pieces[i].first + pieces[i].length;
   }
 
-  return false;
+  return bounds.makeOutset(BLUR_MARGIN, BLUR_MARGIN);
 }
 
-void SkiaManager::eraseStroke(double xpos, double ypos) {
-  auto pathToEraseIter =
-      std::find_if(this->iPaths.begin(), this->iPaths.end(),
-                   [xpos, ypos](const auto &iPath) {
-                     SkPoint clickedPoint = SkPoint::Make(xpos, ypos);
+void SkiaManager::endErase() {
+  if (!this->isErasing)
+    return;
 
-                     return isPointNearPath(iPath, clickedPoint);
-                   });
+  this->journalOp(JOURNAL_ERASE_END);
+  this->finishErase();
+}
 
-  if (pathToEraseIter == this->iPaths.end())
+void SkiaManager::finishErase() {
+  this->isErasing = false;
+
+  if (this->eraseMask != NO_MASK) {
+    Command command = {COMMAND_MASK, NO_STROKE, NO_PAYLOAD};
+    command.mask = this->eraseMask;
+    this->eraseMask = NO_MASK;
+    this->history.record(command);
+  }
+
+  if (this->erasePayload == NO_PAYLOAD)
     return;
 
-  delete *pathToEraseIter;
-  this->iPaths.erase(pathToEraseIter);
+  CommandType type =
+      this->eraserMode == ERASER_SEGMENTS ? COMMAND_SPLIT : COMMAND_ERASE;
+  Command command = {type, NO_STROKE, this->erasePayload};
+  this->erasePayload = NO_PAYLOAD;
+  this->history.record(command);
+}
+
+// An erase going on is recorded as made in the mode it started in
+void SkiaManager::setEraserMode(EraserMode mode) {
+  if (this->eraserMode == mode)
+    return;
 
-  std::cout << "SkiaManager - Erasing stroke at: " << xpos << ", " << ypos
-            << std::endl;
+  this->finishErase();
+  this->eraserMode = mode;
 }
 
+// A stroke being drawn or an erase going on is finished first and undone
+// like any other
 void SkiaManager::undo() {
-  if (this->iPaths.empty()) {
-    std::cerr << "Nothing to undo!" << std::endl;
+  this->awaitJournal();
+  this->finishStroke();
+  this->finishErase();
+
+  Command *command = this->history.undo();
+  if (!command) {
+    LOG_WARNING("drawing", "Nothing to undo!");
     return;
   }
 
-  SkiaPath *lastPath = this->iPaths.back();
-
-  redoStack.push(lastPath);
-  this->iPaths.pop_back();
+  this->journalOp(JOURNAL_UNDO);
+  this->revert(*command);
 
-  std::cout << "Undo performed!" << std::endl;
+  LOG_DEBUG("drawing", "Undo performed!");
 }
 
+// Finishing a stroke being drawn or an erase drops what could be redone
 void SkiaManager::redo() {
-  if (this->redoStack.empty()) {
-    std::cerr << "Nothing to redo!" << std::endl;
+  this->awaitJournal();
+  this->finishStroke();
+  this->finishErase();
+
+  Command *command = this->history.redo();
+  if (!command) {
+    LOG_WARNING("drawing", "Nothing to redo!");
     return;
   }
 
-  SkiaPath *lastPath = this->redoStack.top();
-  this->iPaths.push_back(lastPath);
-  this->redoStack.pop();
+  this->journalOp(JOURNAL_REDO);
+  this->apply(*command);
+
+  LOG_DEBUG("drawing", "Redo performed!");
+}
+
+// Hidden strokes stay in the store, the history releases them once nothing
+// can bring them back
+void SkiaManager::hideStroke(StrokeId stroke) {
+  this->invalidateLayer(stroke);
+  this->layer.remove(stroke, this->tileBounds(stroke));
+  this->grid.removeStroke(stroke, this->strokes.pointsOf(stroke),
+                          this->strokes.widthsOf(stroke),
+                          this->strokes.length(stroke), ERASER_PADDING);
+}
 
-  std::cout << "Redo performed!" << std::endl;
+// Repainted in place, under the strokes drawn after it
+void SkiaManager::showStroke(StrokeId stroke) {
+  this->grid.insertStroke(stroke, this->strokes.pointsOf(stroke),
+                          this->strokes.widthsOf(stroke),
+                          this->strokes.length(stroke), ERASER_PADDING);
+  this->layer.insert(stroke, this->tileBounds(stroke));
+  this->invalidateLayer(stroke);
 }
 
-void SkiaManager::clearRedoStack() {
-  while (!this->redoStack.empty()) {
-    SkiaPath *lastPath = this->redoStack.top();
-    delete lastPath;
+void SkiaManager::clearLayer() {
+  this->layer.clear();
+  this->grid.clear();
+  this->addDamage(0, 0, this->width, this->height);
+}
 
-    this->redoStack.pop();
+void SkiaManager::apply(Command &command) {
+  std::vector<StrokeId> &visible = this->visibleStrokes;
+
+  switch (command.type) {
+  case COMMAND_ADD:
+    visible.push_back(command.stroke);
+    this->grid.insertStroke(command.stroke,
+                            this->strokes.pointsOf(command.stroke),
+                            this->strokes.widthsOf(command.stroke),
+                            this->strokes.length(command.stroke),
+                            ERASER_PADDING);
+    this->layer.insert(command.stroke, this->tileBounds(command.stroke));
+    this->bakeStroke(command.stroke);
+    this->damage.join(this->strokeBounds(command.stroke));
+    break;
+  case COMMAND_ERASE: {
+    CommandPayload &erased = this->history.payload(command.payload);
+    for (size_t i = 0; i < erased.strokes.size(); i++) {
+      StrokeId stroke = erased.strokes[i];
+      uint32_t position = erased.positions[i];
+
+      if (position < visible.size() && visible[position] == stroke)
+        visible.erase(visible.begin() + position);
+      else
+        std::erase(visible, stroke);
+      this->hideStroke(stroke);
+    }
+    break;
+  }
+  case COMMAND_SPLIT: {
+    CommandPayload &split = this->history.payload(command.payload);
+    const StrokePiece *pieces = split.pieces.data();
+    for (size_t i = 0; i < split.strokes.size(); i++) {
+      this->splitStroke(split.strokes[i], split.positions[i], pieces,
+                        split.pieceCounts[i]);
+      pieces += split.pieceCounts[i];
+    }
+    break;
+  }
+  case COMMAND_MASK:
+    this->visibleMasks.push_back(command.mask);
+    this->layer.showMask(command.mask);
+    this->damage.join(this->layer.maskBounds(command.mask));
+    break;
+  case COMMAND_RESET: {
+    CommandPayload &cleared = this->history.payload(command.payload);
+    visible.swap(cleared.strokes);
+    this->visibleMasks.swap(cleared.masks);
+    this->clearLayer();
+    break;
+  }
+  case COMMAND_COLOR:
+    this->currentColor = command.after;
+    break;
+  }
+}
+
+// Strokes loaded after a command was recorded may have moved the ones it
+// touched, they are looked up when not where it left them
+void SkiaManager::revert(Command &command) {
+  std::vector<StrokeId> &visible = this->visibleStrokes;
+
+  switch (command.type) {
+  case COMMAND_ADD:
+    this->hideStroke(command.stroke);
+    if (!visible.empty() && visible.back() == command.stroke)
+      visible.pop_back();
+    else
+      std::erase(visible, command.stroke);
+    break;
+  case COMMAND_ERASE: {
+    // put back last first, so each goes where it was when it went
+    CommandPayload &erased = this->history.payload(command.payload);
+    for (size_t i = erased.strokes.size(); i-- > 0;) {
+      StrokeId stroke = erased.strokes[i];
+      size_t position = std::min<size_t>(erased.positions[i], visible.size());
+
+      visible.insert(visible.begin() + position, stroke);
+      this->showStroke(stroke);
+    }
+    break;
+  }
+  case COMMAND_SPLIT: {
+    // pieces split again are joined back first
+    CommandPayload &split = this->history.payload(command.payload);
+    const StrokePiece *pieces = split.pieces.data() + split.pieces.size();
+    for (size_t i = split.strokes.size(); i-- > 0;) {
+      pieces -= split.pieceCounts[i];
+      this->joinStroke(split.strokes[i], split.positions[i], pieces,
+                       split.pieceCounts[i]);
+    }
+    break;
+  }
+  case COMMAND_MASK: {
+    std::vector<MaskId> &masks = this->visibleMasks;
+    this->layer.hideMask(command.mask);
+    if (!masks.empty() && masks.back() == command.mask)
+      masks.pop_back();
+    else
+      std::erase(masks, command.mask);
+    this->damage.join(this->layer.maskBounds(command.mask));
+    break;
+  }
+  case COMMAND_RESET: {
+    CommandPayload &cleared = this->history.payload(command.payload);
+    visible.swap(cleared.strokes);
+    this->visibleMasks.swap(cleared.masks);
+    for (const auto stroke : visible) {
+      this->grid.insertStroke(stroke, this->strokes.pointsOf(stroke),
+                              this->strokes.widthsOf(stroke),
+                              this->strokes.length(stroke), ERASER_PADDING);
+      this->layer.insert(stroke, this->tileBounds(stroke));
+    }
+    for (const auto mask : this->visibleMasks)
+      this->layer.showMask(mask);
+
+    this->layer.invalidate(SkRect::MakeWH(this->width, this->height));
+    this->addDamage(0, 0, this->width, this->height);
+    break;
+  }
+  case COMMAND_COLOR:
+    this->currentColor = command.before;
+    break;
   }
 }
@@ -1,18 +1,31 @@
 // Copyright (c) 2024 DavidDeadly
 #pragma once
 
-#include <GLFW/glfw3.h>
-#include <stack>
+#include <array>
+#include <string>
 #include <unordered_map>
 #include <vector>
 
+#include "include/core/SkCanvas.h"
 #include "include/core/SkColor.h"
+#include "include/core/SkImage.h"
 #include "include/core/SkPaint.h"
 #include "include/core/SkPath.h"
 #include "include/core/SkPathBuilder.h"
 #include "include/core/SkSurface.h"
 #include "include/gpu/ganesh/GrDirectContext.h"
 
+#include "history.h"
+#include "hit_test.h"
+#include "input.h"
+#include "journal.h"
+#include "layer_tiles.h"
+#include "stroke_file.h"
+#include "stroke_grid.h"
+#include "strokes.h"
+
+const uint64_t JOURNAL_COMPACT_RECORDS = 50000; // between snapshots
+
 enum Color {
   WHITE,
   BLACK,
@@ -22,28 +35,47 @@ enum Color {
   YELLOW,
 };
 
+enum EraserMode : uint8_t {
+  ERASER_STROKES,  // whole strokes
+  ERASER_SEGMENTS, // only what it goes over, splitting the strokes
+  ERASER_PIXELS,   // the pixels under it, through a mask over the strokes
+};
+
 class IDrawingManager {
 public:
   virtual void init(int width, int height) = 0;
   virtual void cleanUp() = 0;
-  virtual void display() = 0;
+  virtual void display(int bufferAge) = 0;
+  virtual bool needsRedraw() = 0;
+  virtual void addDamage(float left, float top, float right,
+                         float bottom) = 0;
+  // returns when the oldest sample applied was taken, 0 if there was none
+  virtual uint64_t processInput(InputQueue &queue) = 0;
+  virtual bool saveDrawing(const char *path) = 0;
+  virtual bool loadDrawing(const char *path) = 0;
+  virtual bool openJournal(const char *drawingPath) = 0;
 
   virtual void undo() = 0;
   virtual void redo() = 0;
   virtual void reset() = 0;
   virtual void changeColor(float rgba[4]) = 0;
   virtual void changeColor(float rgba[4], Color color) = 0;
-  virtual void drawLine(bool isDrawing, double xpos, double ypos) = 0;
+  // the color in use, which undoing can change
+  virtual void readColor(float rgba[4]) = 0;
+  virtual void drawLine(bool isDrawing, double xpos, double ypos,
+                        float pressure) = 0;
+  // erases what the eraser went over since its last position, until it
+  // lifts
   virtual void eraseStroke(double xpos, double ypos) = 0;
-};
-
-struct SkiaPath {
-  SkPath *path;
-  SkPaint paint;
-
-  SkiaPath(SkPath *path, SkPaint paint) : path(path), paint(paint) {}
-
-  ~SkiaPath() { delete path; }
+  virtual void endErase() = 0;
+  virtual void setEraserMode(EraserMode mode) = 0;
+
+  virtual StrokeHandle beginStroke(double xpos, double ypos,
+                                   float pressure) = 0;
+  virtual bool appendPoint(StrokeHandle stroke, double xpos, double ypos,
+                           float pressure) = 0;
+  virtual void endStroke(StrokeHandle stroke) = 0;
+  virtual void cancelStroke(StrokeHandle stroke) = 0;
 };
 
 class SkiaManager : public IDrawingManager {
@@ -52,33 +84,144 @@ private:
   int height;
 
   SkSurface *surface;
-  GrDirectContext *context;
-
-  SkPath *currentPath;
-  SkPaint *currentPaint = new SkPaint();
+  GrDirectContext *context = nullptr; // none on the raster backend
+
+  // finished strokes are baked here once, so a frame only composites this
+  // layer plus the stroke being drawn
+  LayerTiles layer;
+  WorkerPool *tilePool = nullptr; // raster backend only
+
+  // area changed since the last frame, kept for a few frames so a back
+  // buffer of a known age only gets its stale pixels repainted
+  static const int DAMAGE_HISTORY = 4;
+  SkRect damage = SkRect::MakeEmpty();
+  std::array<SkRect, DAMAGE_HISTORY> damageHistory = {};
+  int lastFrame = 0;
+
+  StrokeId currentStroke = NO_STROKE;
+  StrokeHandle cursorStroke;
+
+  // how far the stored path may stray from the input, 0 keeps every sample
+  float simplifyTolerance = 0.5f;
+  // the last sample left out of the live stroke, kept so it still ends
+  // where the pen lifted
+  bool hasPendingPoint = false;
+  SkPoint pendingPoint;
+  float pendingWidth;
+
+  bool isTabletNear = false;
   SkColor currentColor = SK_ColorWHITE;
 
-  std::stack<SkiaPath *> redoStack;
-  std::vector<SkiaPath *> iPaths;
+  StrokeStore strokes;
+  std::vector<StrokeId> visibleStrokes;
+  std::vector<MaskId> visibleMasks; // bottom to top
+  History history{this->strokes, this->layer};
+  StrokeGrid grid;
+
+  // the eraser down, the strokes it went over are one step to undo
+  EraserMode eraserMode = ERASER_STROKES;
+  bool isErasing = false;
+  SkPoint eraserPosition;
+  uint32_t erasePayload = NO_PAYLOAD;
+  MaskId eraseMask = NO_MASK;
+  std::vector<GridEntry> eraserCandidates;
+  HitSegments hitSegments;
+  std::vector<GridEntry> eraserHits;
+
+  // a drawing being loaded, a block of strokes per frame
+  StrokeFileReader *drawingReader = nullptr;
+  StrokeBatch loadedBatch;
+  uint64_t drawingSequence = 0;
+
+  // every operation is journaled once one is open, its snapshots replace
+  // the drawing it was opened for
+  Journal *journal = nullptr;
+  Journal *pendingJournal = nullptr; // replayed once the drawing is loaded
+  std::string journalDrawing;
+  uint64_t journalCompactRecords = JOURNAL_COMPACT_RECORDS;
+  StrokeHandle replayedStroke;
 
   std::unordered_map<Color, std::array<float, 4>> colors = {
       {WHITE, {1, 1, 1, 1}}, {BLACK, {0, 0, 0, 1}}, {RED, {1, 0, 0, 1}},
       {GREEN, {0, 1, 0, 1}}, {BLUE, {0, 0, 1, 1}},  {YELLOW, {1, 1, 0, 1}},
   };
 
-  void clearRedoStack();
-  SkPaint *generatePaint();
+  void initLayers();
+  void setColor(SkColor color);
+  void erase(StrokeId stroke);
+  void cut(StrokeId stroke, const GridEntry *hits, size_t count);
+  void erasePixels(SkPoint from, SkPoint to);
+  void finishErase();
+  void splitStroke(StrokeId stroke, uint32_t position,
+                   const StrokePiece *pieces, uint32_t count);
+  void joinStroke(StrokeId stroke, uint32_t position,
+                  const StrokePiece *pieces, uint32_t count);
+  SkRect cutBounds(StrokeId stroke, const StrokePiece *pieces,
+                   uint32_t count);
+  void hideStroke(StrokeId stroke);
+  void showStroke(StrokeId stroke);
+  void clearLayer();
+  void revert(Command &command);
+  void apply(Command &command);
+  SkPaint generatePaint(SkColor color);
+  uint16_t styleFor(SkColor color);
+  void loadBlock();
+  void loadMask(const MaskPixels &pixels);
+  std::vector<MaskPixels> savedMasks();
+  void journalOp(JournalOp op, float x = 0, float y = 0, float pressure = 0);
+  void replayOp(const JournalRecord &record);
+  void replayJournal(Journal *journal);
+  void awaitJournal();
+  void compactJournal();
+
+  void applySample(const InputSample &sample);
+  bool isLive(StrokeHandle stroke);
+  void finishStroke();
+  void extendStroke(StrokeId stroke, double xpos, double ypos,
+                    float pressure);
+  void addPoint(StrokeId stroke, SkPoint point, float width);
+  void simplify(StrokeId stroke);
+  void drawLiveStroke(SkCanvas *canvas);
+  void bakeStroke(StrokeId stroke);
+  SkPaint bakedPaint(StrokeId stroke);
+  SkRect strokeBounds(StrokeId stroke);
+  SkRect tileBounds(StrokeId stroke);
+  void invalidateLayer(StrokeId stroke);
+  void repairLayer();
+  void repairTile(LayerTile &tile);
+  SkRect repaintRegion(int bufferAge);
 
 public:
   void init(int width, int height);
+  void initRaster(int width, int height);
   void cleanUp();
-  void display();
+  sk_sp<SkImage> snapshot();
+  void display(int bufferAge);
+  bool needsRedraw();
+  void addDamage(float left, float top, float right, float bottom);
+  uint64_t processInput(InputQueue &queue);
+  bool saveDrawing(const char *path);
+  bool loadDrawing(const char *path);
+  bool openJournal(const char *drawingPath);
+  void setSimplifyTolerance(float tolerance);
+  void setHistoryBudget(size_t bytes);
+  void setJournalCompaction(uint64_t records);
+  size_t pointCount();
 
   void reset();
   void undo();
   void redo();
   void changeColor(float rgba[4]);
   void changeColor(float rgba[4], Color color);
+  void readColor(float rgba[4]);
   void eraseStroke(double xpos, double ypos);
-  void drawLine(bool isDrawing, double xpos, double ypost);
+  void endErase();
+  void setEraserMode(EraserMode mode);
+  void drawLine(bool isDrawing, double xpos, double ypost, float pressure);
+
+  StrokeHandle beginStroke(double xpos, double ypos, float pressure);
+  bool appendPoint(StrokeHandle stroke, double xpos, double ypos,
+                   float pressure);
+  void endStroke(StrokeHandle stroke);
+  void cancelStroke(StrokeHandle stroke);
 };
@@ -0,0 +1,60 @@
+// Copyright (c) 2024 DavidDeadly
+#include "drawing.h"
+
+#define SK_GANESH
+#define SK_GL // For GrContext::MakeGL
+#include <GLFW/glfw3.h>
+
+#include "include/core/SkColorSpace.h"
+#include "include/gpu/ganesh/GrBackendSurface.h"
+#include "include/gpu/ganesh/SkSurfaceGanesh.h"
+#include "include/gpu/ganesh/gl/GrGLAssembleInterface.h"
+#include "include/gpu/ganesh/gl/GrGLBackendSurface.h"
+#include "include/gpu/ganesh/gl/GrGLDirectContext.h"
+
+void SkiaManager::init(int width, int height) {
+  this->width = width;
+  this->height = height;
+
+  auto interface = GrGLMakeNativeInterface();
+  if (interface == nullptr) {
+    // backup plan. see
+    // https://gist.github.com/ad8e/dd150b775ae6aa4d5cf1a092e4713add?permalink_comment_id=4680136#gistcomment-4680136
+    interface = GrGLMakeAssembledInterface(
+        nullptr, (GrGLGetProc) * [](void *, const char *p) -> void * {
+          return (void *)glfwGetProcAddress(p);
+        });
+  }
+
+  this->context = GrDirectContexts::MakeGL(interface).release();
+
+  GrGLFramebufferInfo framebufferInfo;
+  framebufferInfo.fFBOID = 0; // assume default framebuffer
+
+  // We are always using OpenGL and we use RGBA8 internal format for both RGBA
+  // and BGRA configs in OpenGL.
+  //(replace line below with this one to enable correct color spaces)
+  // framebufferInfo.fFormat = GL_SRGB8_ALPHA8;
+  framebufferInfo.fFormat = GL_RGBA8;
+
+  SkColorType colorType = kRGBA_8888_SkColorType;
+  GrBackendRenderTarget backendRenderTarget =
+      GrBackendRenderTargets::MakeGL(width, height,
+                                     0, // sample count
+                                     0, // stencil bits
+                                     framebufferInfo);
+
+  //(replace line below with this one to enable correct color spaces)
+  // sSurface= SkSurfaces::WrapBackendRenderTarget(sContext,
+  // backendRenderTarget, kBottomLeft_GrSurfaceOrigin, colorType,
+  // SkColorSpace::MakeSRGB(), nullptr).release();
+  this->surface = SkSurfaces::WrapBackendRenderTarget(
+                      context, backendRenderTarget, kBottomLeft_GrSurfaceOrigin,
+                      colorType, nullptr, nullptr)
+                      .release();
+
+  if (this->surface == nullptr)
+    abort();
+
+  this->initLayers();
+}
@@ -0,0 +1,237 @@
+// Copyright (c) 2024 DavidDeadly
+#include "evdev_replay.h"
+
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <fcntl.h>
+#include <iostream>
+#include <poll.h>
+#include <sys/ioctl.h>
+#include <thread>
+#include <unistd.h>
+
+const int POLL_TIMEOUT_MS = 100;
+const uint64_t REPLAY_FRAME_NS = 16666667;
+
+static uint64_t eventTimestamp(const struct input_event &event) {
+  return event.input_event_sec * 1000000000ull +
+         event.input_event_usec * 1000ull;
+}
+
+static float normalize(int value, const struct input_absinfo &axis) {
+  int range = axis.maximum - axis.minimum;
+  if (range <= 0)
+    return 0;
+
+  return (float)(value - axis.minimum) / range;
+}
+
+// evdev tilt resolution is in units per radian, libinput reports degrees
+static float toDegrees(int value, const struct input_absinfo &axis) {
+  if (axis.resolution <= 0)
+    return value;
+
+  return value * 180.0f / M_PI / axis.resolution;
+}
+
+EvdevDecoder::EvdevDecoder(const EvdevAxes &axes) {
+  this->axes = axes;
+  this->pending.pressure = 1;
+  this->pending.isTablet = true;
+}
+
+void EvdevDecoder::setArea(int width, int height) {
+  this->width = width;
+  this->height = height;
+}
+
+bool EvdevDecoder::decode(const struct input_event &event,
+                          InputSample &sample) {
+  if (event.type == EV_ABS) {
+    if (event.code == ABS_X)
+      this->pending.x = normalize(event.value, this->axes.x) * this->width;
+    else if (event.code == ABS_Y)
+      this->pending.y = normalize(event.value, this->axes.y) * this->height;
+    else if (event.code == ABS_PRESSURE)
+      this->pending.pressure = normalize(event.value, this->axes.pressure);
+    else if (event.code == ABS_TILT_X)
+      this->pending.tiltX = toDegrees(event.value, this->axes.tiltX);
+    else if (event.code == ABS_TILT_Y)
+      this->pending.tiltY = toDegrees(event.value, this->axes.tiltY);
+
+    return false;
+  }
+
+  if (event.type == EV_KEY) {
+    if (event.code == BTN_TOUCH)
+      this->pending.isDown = event.value != 0;
+    else if (event.code == BTN_TOOL_PEN)
+      this->isPenNear = event.value != 0;
+    else if (event.code == BTN_TOOL_RUBBER)
+      this->isRubberNear = event.value != 0;
+
+    return false;
+  }
+
+  bool isReport = event.type == EV_SYN && event.code == SYN_REPORT;
+  if (!isReport)
+    return false;
+
+  this->pending.timestamp = eventTimestamp(event);
+  this->pending.tool = TOOL_NONE;
+  if (this->isPenNear)
+    this->pending.tool = TOOL_PEN;
+  if (this->isRubberNear)
+    this->pending.tool = TOOL_ERASER;
+
+  if (this->pending.tool == TOOL_NONE)
+    this->pending.isDown = false;
+
+  sample = this->pending;
+  return true;
+}
+
+bool recordEvdev(const char *devicePath, const char *recordingPath,
+                 const std::atomic<bool> &running) {
+  int device = open(devicePath, O_RDONLY | O_NONBLOCK);
+  if (device < 0) {
+    std::cerr << "Failed to open input device: " << devicePath << std::endl;
+    return false;
+  }
+
+  EvdevAxes axes = {};
+  ioctl(device, EVIOCGABS(ABS_X), &axes.x);
+  ioctl(device, EVIOCGABS(ABS_Y), &axes.y);
+  ioctl(device, EVIOCGABS(ABS_PRESSURE), &axes.pressure);
+  ioctl(device, EVIOCGABS(ABS_TILT_X), &axes.tiltX);
+  ioctl(device, EVIOCGABS(ABS_TILT_Y), &axes.tiltY);
+
+  FILE *recording = fopen(recordingPath, "wb");
+  if (!recording) {
+    std::cerr << "Failed to create recording: " << recordingPath << std::endl;
+    close(device);
+    return false;
+  }
+
+  fwrite(EVDEV_MAGIC, sizeof(EVDEV_MAGIC), 1, recording);
+  fwrite(&axes, sizeof(axes), 1, recording);
+
+  struct pollfd descriptor = {device, POLLIN, 0};
+  struct input_event events[64];
+
+  while (running) {
+    if (poll(&descriptor, 1, POLL_TIMEOUT_MS) <= 0)
+      continue;
+
+    ssize_t bytes = read(device, events, sizeof(events));
+    if (bytes <= 0)
+      continue;
+
+    fwrite(events, sizeof(struct input_event),
+           bytes / sizeof(struct input_event), recording);
+  }
+
+  fclose(recording);
+  close(device);
+
+  return true;
+}
+
+EvdevReplaySource::EvdevReplaySource(const char *recordingPath,
+                                     bool isRealtime) {
+  this->isRealtime = isRealtime;
+
+  FILE *recording = fopen(recordingPath, "rb");
+  if (!recording) {
+    std::cerr << "Failed to open recording: " << recordingPath << std::endl;
+    return;
+  }
+
+  char magic[sizeof(EVDEV_MAGIC)];
+  EvdevAxes axes;
+
+  bool hasHeader = fread(magic, sizeof(magic), 1, recording) == 1 &&
+                   memcmp(magic, EVDEV_MAGIC, sizeof(magic)) == 0 &&
+                   fread(&axes, sizeof(axes), 1, recording) == 1;
+
+  if (!hasHeader) {
+    std::cerr << "Invalid evdev recording: " << recordingPath << std::endl;
+    fclose(recording);
+    return;
+  }
+
+  this->recording = recording;
+  this->decoder = new EvdevDecoder(axes);
+}
+
+EvdevReplaySource::~EvdevReplaySource() {
+  if (this->recording)
+    fclose(this->recording);
+
+  delete this->decoder;
+}
+
+void EvdevReplaySource::setArea(int width, int height) {
+  if (this->decoder)
+    this->decoder->setArea(width, height);
+}
+
+void EvdevReplaySource::stop() { this->running = false; }
+
+// Decodes the recording up to its next report, false once it is over
+bool EvdevReplaySource::readSample(InputSample &sample) {
+  if (!this->recording)
+    return false;
+
+  struct input_event event;
+  while (fread(&event, sizeof(event), 1, this->recording)) {
+    if (this->decoder->decode(event, sample))
+      return true;
+  }
+
+  return false;
+}
+
+bool EvdevReplaySource::nextFrame(InputQueue &queue) {
+  if (!this->hasNextReport)
+    this->hasNextReport = this->readSample(this->nextReport);
+  if (!this->hasNextReport)
+    return false;
+
+  uint64_t frameEnd = this->nextReport.timestamp + REPLAY_FRAME_NS;
+  while (this->hasNextReport && this->nextReport.timestamp < frameEnd) {
+    InputSample sample = this->nextReport;
+    sample.timestamp = inputTimestamp();
+    if (!pushSample(queue, sample, this->running))
+      return false;
+
+    this->hasNextReport = this->readSample(this->nextReport);
+  }
+
+  return true;
+}
+
+void EvdevReplaySource::run(InputQueue &queue, std::function<void()> notify) {
+  InputSample sample;
+
+  uint64_t firstEvent = 0;
+  uint64_t replayStart = inputTimestamp();
+
+  while (this->running && this->readSample(sample)) {
+    if (firstEvent == 0)
+      firstEvent = sample.timestamp;
+
+    // keep the recorded spacing between reports, at the device rate
+    uint64_t dueAt = replayStart + (sample.timestamp - firstEvent);
+    uint64_t now = inputTimestamp();
+    if (this->isRealtime && dueAt > now)
+      std::this_thread::sleep_for(std::chrono::nanoseconds(dueAt - now));
+
+    sample.timestamp = inputTimestamp();
+    if (!pushSample(queue, sample, this->running))
+      return;
+
+    notify();
+  }
+}
@@ -0,0 +1,72 @@
+// Copyright (c) 2024 DavidDeadly
+#pragma once
+
+#include <atomic>
+#include <cstdio>
+#include <linux/input.h>
+
+#include "input.h"
+
+// Ranges of the axes the recorded device reported
+struct EvdevAxes {
+  struct input_absinfo x;
+  struct input_absinfo y;
+  struct input_absinfo pressure;
+  struct input_absinfo tiltX;
+  struct input_absinfo tiltY;
+};
+
+// Turns raw evdev events of a tablet into one sample per SYN_REPORT, the
+// same frames libinput builds its tablet events from
+class EvdevDecoder {
+private:
+  EvdevAxes axes;
+  int width = 0;
+  int height = 0;
+
+  InputSample pending = {};
+  // a frame can bring one tool in and the other out in any order, the tool
+  // is only picked at its report
+  bool isPenNear = false;
+  bool isRubberNear = false;
+
+public:
+  EvdevDecoder(const EvdevAxes &axes);
+
+  void setArea(int width, int height);
+  bool decode(const struct input_event &event, InputSample &sample);
+};
+
+// Recordings are a header with the axes followed by the raw input_events
+// read from the device node
+const char EVDEV_MAGIC[8] = {'I', 'P', 'E', 'N', 'E', 'V', 'D', '1'};
+
+bool recordEvdev(const char *devicePath, const char *recordingPath,
+                 const std::atomic<bool> &running);
+
+// Plays a recording back as if the tablet was plugged in, so the tablet
+// path can be exercised on a machine without one
+class EvdevReplaySource : public IInputSource {
+private:
+  std::atomic<bool> running = true;
+  FILE *recording = NULL;
+  EvdevDecoder *decoder = NULL;
+  bool isRealtime;
+
+  InputSample nextReport;
+  bool hasNextReport = false;
+
+  bool readSample(InputSample &sample);
+
+public:
+  EvdevReplaySource(const char *recordingPath, bool isRealtime);
+  ~EvdevReplaySource();
+
+  // Queues the reports of the next frame interval of the recording, false
+  // once it is over
+  bool nextFrame(InputQueue &queue);
+
+  void setArea(int width, int height);
+  void run(InputQueue &queue, std::function<void()> notify);
+  void stop();
+};
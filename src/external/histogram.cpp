@@ -0,0 +1,64 @@
+// Copyright (c) 2024 DavidDeadly
+#include "histogram.h"
+
+#include <algorithm>
+#include <string>
+
+const double BUCKET_MS = 0.1;
+
+void LatencyHistogram::add(double milliseconds) {
+  int bucket = std::clamp((int)(milliseconds / BUCKET_MS), 0, BUCKETS - 1);
+
+  this->buckets[bucket]++;
+  this->count++;
+  this->total += milliseconds;
+  this->slowest = std::max(this->slowest, milliseconds);
+}
+
+void LatencyHistogram::clear() {
+  this->buckets.fill(0);
+  this->count = 0;
+  this->total = 0;
+  this->slowest = 0;
+}
+
+// Upper edge of the bucket holding the given fraction of the samples
+double LatencyHistogram::percentile(double fraction) {
+  uint64_t rank = fraction * this->count;
+  uint64_t seen = 0;
+
+  for (int bucket = 0; bucket < BUCKETS; bucket++) {
+    seen += this->buckets[bucket];
+    bool isOverflow = bucket == BUCKETS - 1;
+    if (seen > rank && !isOverflow)
+      return std::min((bucket + 1) * BUCKET_MS, this->slowest);
+  }
+
+  return this->slowest;
+}
+
+// Summary plus the distribution over doubling ranges, 1ms, 2ms, 4ms...
+void LatencyHistogram::print(std::ostream &out, const char *name) {
+  out << name << ": " << this->count << " samples, mean " << this->mean()
+      << " ms, p50 " << this->percentile(0.5) << " ms, p95 "
+      << this->percentile(0.95) << " ms, p99 " << this->percentile(0.99)
+      << " ms, max " << this->slowest << " ms" << std::endl;
+
+  if (this->count == 0)
+    return;
+
+  const int BAR_WIDTH = 40;
+  int bucket = 0;
+
+  for (double limit = 1; bucket < BUCKETS; limit *= 2) {
+    uint64_t inRange = 0;
+    for (; bucket < BUCKETS && bucket * BUCKET_MS < limit; bucket++)
+      inRange += this->buckets[bucket];
+
+    bool isLast = bucket == BUCKETS;
+    int bar = inRange * BAR_WIDTH / this->count;
+
+    out << "  " << (isLast ? "> " : "< ") << (isLast ? limit / 2 : limit)
+        << " ms\t" << std::string(bar, '#') << " " << inRange << std::endl;
+  }
+}
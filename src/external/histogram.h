@@ -0,0 +1,28 @@
+// Copyright (c) 2024 DavidDeadly
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <ostream>
+
+// Durations counted in buckets of 0.1ms up to 100ms, anything slower lands
+// in the last one. Percentiles are as precise as a bucket.
+class LatencyHistogram {
+private:
+  static const int BUCKETS = 1001;
+  std::array<uint64_t, BUCKETS> buckets = {};
+  uint64_t count = 0;
+  double total = 0;
+  double slowest = 0;
+
+public:
+  void add(double milliseconds);
+  void clear();
+
+  uint64_t samples() { return this->count; }
+  double mean() { return this->count ? this->total / this->count : 0; }
+  double max() { return this->slowest; }
+  double percentile(double fraction);
+
+  void print(std::ostream &out, const char *name);
+};
@@ -0,0 +1,236 @@
+// Copyright (c) 2024 DavidDeadly
+#include "history.h"
+
+#include "log.h"
+
+History::History(StrokeStore &strokes, LayerTiles &layer)
+    : strokes(strokes), layer(layer), commands(HISTORY_CAPACITY) {}
+
+void History::setBudget(size_t budget) { this->budget = budget; }
+
+size_t History::strokeBytes(StrokeId stroke) {
+  return this->strokes.length(stroke) * (sizeof(SkPoint) + sizeof(float));
+}
+
+// Adding hides the stroke or mask while undone, erasing and resetting while
+// done.
+// Splitting hides the pieces while undone and the split strokes while done,
+// but they share their points, only the ones cut out are kept for it.
+size_t History::hiddenBytes(const Command &command, bool isDone) {
+  switch (command.type) {
+  case COMMAND_ADD:
+  case COMMAND_MASK:
+    return isDone ? 0 : command.bytes;
+  case COMMAND_ERASE:
+  case COMMAND_SPLIT:
+  case COMMAND_RESET:
+    return isDone ? command.bytes : 0;
+  case COMMAND_COLOR:
+    return 0;
+  }
+
+  return 0;
+}
+
+// Strokes only a dropped command could bring back are gone for good
+void History::drop(Command &command, bool isDone) {
+  this->bytes -= this->hiddenBytes(command, isDone);
+
+  switch (command.type) {
+  case COMMAND_ADD:
+    if (!isDone)
+      this->strokes.release(command.stroke);
+    break;
+  case COMMAND_ERASE:
+  case COMMAND_RESET: {
+    CommandPayload &hidden = this->payloads[command.payload];
+    if (isDone) {
+      for (const auto stroke : hidden.strokes)
+        this->strokes.release(stroke);
+      for (const auto mask : hidden.masks)
+        this->layer.releaseMask(mask);
+    }
+
+    hidden.strokes.clear();
+    hidden.positions.clear();
+    hidden.masks.clear();
+    this->freePayloads.push_back(command.payload);
+    break;
+  }
+  case COMMAND_SPLIT: {
+    // pieces split again are among the strokes too, hidden either way
+    CommandPayload &split = this->payloads[command.payload];
+    if (isDone)
+      for (const auto stroke : split.strokes)
+        this->strokes.release(stroke);
+    else
+      // last cut first, a piece cut again still holds its points when its
+      // own pieces are checked against them
+      for (size_t i = split.strokes.size(), end = split.pieces.size();
+           i-- > 0;) {
+        size_t begin = end - split.pieceCounts[i];
+        for (size_t j = begin; j < end; j++)
+          this->strokes.releasePiece(split.pieces[j].stroke, split.strokes[i]);
+        end = begin;
+      }
+
+    split.strokes.clear();
+    split.positions.clear();
+    split.pieceCounts.clear();
+    split.pieces.clear();
+    this->freePayloads.push_back(command.payload);
+    break;
+  }
+  case COMMAND_MASK:
+    if (!isDone)
+      this->layer.releaseMask(command.mask);
+    break;
+  case COMMAND_COLOR:
+    break;
+  }
+}
+
+// Oldest first, and only once nothing done is left the newest undone ones,
+// which nothing after them depends on
+void History::evict() {
+  while (this->count > 0 && this->bytes > this->budget) {
+    if (this->done > 0) {
+      this->drop(this->at(0), true);
+      this->first = (this->first + 1) % this->commands.size();
+      this->count--;
+      this->done--;
+    } else {
+      this->drop(this->at(this->count - 1), false);
+      this->count--;
+    }
+  }
+}
+
+void History::record(const Command &command) {
+  while (this->count > this->done) {
+    this->drop(this->at(this->count - 1), false);
+    this->count--;
+  }
+
+  if (this->count == this->commands.size()) {
+    this->drop(this->at(0), true);
+    this->first = (this->first + 1) % this->commands.size();
+    this->count--;
+    this->done--;
+  }
+
+  Command &recorded = this->at(this->count);
+  recorded = command;
+
+  switch (recorded.type) {
+  case COMMAND_ADD:
+    recorded.bytes = this->strokeBytes(recorded.stroke);
+    break;
+  case COMMAND_ERASE:
+  case COMMAND_RESET: {
+    CommandPayload &hidden = this->payloads[recorded.payload];
+    recorded.bytes = 0;
+    for (const auto stroke : hidden.strokes)
+      recorded.bytes += this->strokeBytes(stroke) + sizeof(StrokeId) +
+                        sizeof(uint32_t);
+    for (const auto mask : hidden.masks)
+      recorded.bytes += this->layer.maskBytes(mask) + sizeof(MaskId);
+    break;
+  }
+  case COMMAND_SPLIT: {
+    // what the pieces keep of the split strokes is shared with them
+    CommandPayload &split = this->payloads[recorded.payload];
+    size_t splitBytes = 0;
+    size_t keptBytes = 0;
+    for (const auto stroke : split.strokes)
+      splitBytes += this->strokeBytes(stroke);
+    for (const auto &piece : split.pieces)
+      keptBytes += this->strokeBytes(piece.stroke);
+
+    recorded.bytes =
+        splitBytes - keptBytes +
+        split.strokes.size() * (sizeof(StrokeId) + 2 * sizeof(uint32_t)) +
+        split.pieces.size() * sizeof(StrokePiece);
+    break;
+  }
+  case COMMAND_MASK:
+    recorded.bytes = this->layer.maskBytes(recorded.mask);
+    break;
+  case COMMAND_COLOR:
+    recorded.bytes = 0;
+    break;
+  }
+
+  this->count++;
+  this->done++;
+  this->bytes += this->hiddenBytes(recorded, true);
+
+  if (this->bytes > this->budget) {
+    this->evict();
+    LOG_DEBUG("history", "Evicted down to %zu commands", this->count);
+  }
+}
+
+void History::recordColor(SkColor before, SkColor after) {
+  bool isMerged = this->done > 0 && this->done == this->count &&
+                  this->at(this->done - 1).type == COMMAND_COLOR;
+  if (isMerged) {
+    this->at(this->done - 1).after = after;
+    return;
+  }
+
+  Command command = {};
+  command.type = COMMAND_COLOR;
+  command.stroke = NO_STROKE;
+  command.payload = NO_PAYLOAD;
+  command.mask = NO_MASK;
+  command.before = before;
+  command.after = after;
+  this->record(command);
+}
+
+Command *History::undo() {
+  if (this->done == 0)
+    return nullptr;
+
+  Command &command = this->at(--this->done);
+  this->bytes -= this->hiddenBytes(command, true);
+  this->bytes += this->hiddenBytes(command, false);
+
+  return &command;
+}
+
+Command *History::redo() {
+  if (this->done == this->count)
+    return nullptr;
+
+  Command &command = this->at(this->done++);
+  this->bytes -= this->hiddenBytes(command, false);
+  this->bytes += this->hiddenBytes(command, true);
+
+  return &command;
+}
+
+// Oldest first, as the budget would drop them, so a split stroke is released
+// before the pieces of it erased later
+void History::clear() {
+  for (size_t i = 0; i < this->count; i++)
+    this->drop(this->at(i), i < this->done);
+
+  this->count = 0;
+  this->first = 0;
+  this->done = 0;
+  this->bytes = 0;
+}
+
+uint32_t History::takePayload() {
+  if (this->freePayloads.empty()) {
+    this->payloads.emplace_back();
+    return this->payloads.size() - 1;
+  }
+
+  uint32_t payload = this->freePayloads.back();
+  this->freePayloads.pop_back();
+
+  return payload;
+}
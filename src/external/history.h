@@ -0,0 +1,103 @@
+// Copyright (c) 2024 DavidDeadly
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "include/core/SkColor.h"
+
+#include "layer_tiles.h"
+#include "strokes.h"
+
+const size_t HISTORY_CAPACITY = 4096;    // commands
+const size_t HISTORY_BUDGET = 64 << 20; // bytes of hidden strokes and masks
+const uint32_t NO_PAYLOAD = UINT32_MAX;
+
+enum CommandType : uint8_t {
+  COMMAND_ADD,
+  COMMAND_ERASE,
+  COMMAND_SPLIT,
+  COMMAND_RESET,
+  COMMAND_COLOR,
+  COMMAND_MASK,
+};
+
+// Strokes erased, split or cleared by a command, and the masks it cleared.
+// Erased and split ones are listed in the order they went, each with where
+// it was among the visible strokes then, and split ones with how many of
+// the pieces are theirs.
+struct CommandPayload {
+  std::vector<StrokeId> strokes;
+  std::vector<uint32_t> positions;
+  std::vector<uint32_t> pieceCounts;
+  std::vector<StrokePiece> pieces;
+  std::vector<MaskId> masks;
+};
+
+// What an operation changed, enough to revert and apply it again. Strokes
+// an operation hides stay in the store under their id, and masks in the
+// layer, so no copy of them is kept.
+struct Command {
+  CommandType type;
+  StrokeId stroke;  // added
+  uint32_t payload; // erased, split or cleared
+  SkColor before;
+  SkColor after;
+  size_t bytes; // of the strokes and masks it adds, erases or clears, or
+                // the points it cuts out
+  MaskId mask;  // erased with
+};
+
+// Undo history as a ring of commands and a cursor between the done and
+// the undone ones. Hidden strokes and masks count against a memory budget:
+// recording drops the oldest commands until it fits again, releasing the
+// strokes and masks only they kept. Payloads are pooled, so once warmed up
+// neither recording nor undoing allocates.
+class History {
+private:
+  StrokeStore &strokes;
+  LayerTiles &layer;
+
+  std::vector<Command> commands;
+  size_t first = 0; // oldest command in the ring
+  size_t count = 0;
+  size_t done = 0;
+
+  size_t bytes = 0; // of the strokes hidden by some command
+  size_t budget = HISTORY_BUDGET;
+
+  std::vector<CommandPayload> payloads;
+  std::vector<uint32_t> freePayloads;
+
+  Command &at(size_t index) {
+    return this->commands[(this->first + index) % this->commands.size()];
+  }
+
+  size_t strokeBytes(StrokeId stroke);
+  size_t hiddenBytes(const Command &command, bool isDone);
+  void drop(Command &command, bool isDone);
+  void evict();
+
+public:
+  History(StrokeStore &strokes, LayerTiles &layer);
+
+  void setBudget(size_t budget);
+  size_t retainedBytes() { return this->bytes; }
+
+  // undone commands are dropped, a new one can't be redone after them
+  void record(const Command &command);
+  // keeps recording color changes made one after another, like dragging
+  // through the picker, as a single one
+  void recordColor(SkColor before, SkColor after);
+
+  // the command to revert or apply again, null when there is none
+  Command *undo();
+  Command *redo();
+  void clear();
+
+  uint32_t takePayload();
+  CommandPayload &payload(uint32_t index) {
+    return this->payloads[index];
+  }
+};
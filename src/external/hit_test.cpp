@@ -0,0 +1,370 @@
+// Copyright (c) 2024 DavidDeadly
+#include "hit_test.h"
+
+#include <algorithm>
+#include <cfloat>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define IPEN_X86 1
+#include <immintrin.h>
+#endif
+
+void HitSegments::clear() {
+  this->startX.clear();
+  this->startY.clear();
+  this->endX.clear();
+  this->endY.clear();
+  this->radiusSquared.clear();
+  this->owners.clear();
+}
+
+void HitSegments::add(SkPoint start, SkPoint end, float radius,
+                      uint32_t owner) {
+  this->startX.push_back(start.fX);
+  this->startY.push_back(start.fY);
+  this->endX.push_back(end.fX);
+  this->endY.push_back(end.fY);
+  this->radiusSquared.push_back(radius * radius);
+  this->owners.push_back(owner);
+}
+
+void HitSegments::addCurve(const StrokeCurve &curve, float radius,
+                           uint32_t owner) {
+  if (isStraight(curve)) {
+    this->add(curve.start, curve.end, radius, owner);
+    return;
+  }
+
+  SkPoint chordStart = curve.start;
+  for (int chord = 1; chord <= CURVE_CHORDS; chord++) {
+    SkPoint chordEnd = curvePoint(curve, (float)chord / CURVE_CHORDS);
+    this->add(chordStart, chordEnd, radius, owner);
+    chordStart = chordEnd;
+  }
+}
+
+// Every kernel projects the point on the segment, clamps the projection to
+// its ends and takes the squared distance to the closest point. An empty
+// segment's length is raised to the smallest float so it projects on its
+// start instead of dividing by zero.
+static float distanceSquared(float px, float py, float dx, float dy) {
+  float lengthSquared = std::max(dx * dx + dy * dy, FLT_MIN);
+  float t = std::clamp((px * dx + py * dy) / lengthSquared, 0.0f, 1.0f);
+
+  float cx = px - t * dx;
+  float cy = py - t * dy;
+  return cx * cx + cy * cy;
+}
+
+static size_t firstHitScalar(HitSegments &segments, float x, float y,
+                             size_t first) {
+  for (size_t i = first; i < segments.size(); i++) {
+    float dx = segments.endX[i] - segments.startX[i];
+    float dy = segments.endY[i] - segments.startY[i];
+    float distance = distanceSquared(x - segments.startX[i],
+                                     y - segments.startY[i], dx, dy);
+    if (distance <= segments.radiusSquared[i])
+      return i;
+  }
+
+  return NO_HIT;
+}
+
+// Two segments that don't cross are closest at an end of one of them, so
+// the swept test is the nearest of the four ends to the other segment, or
+// none when they cross
+static size_t firstSweptHitScalar(HitSegments &segments, SkPoint from,
+                                  SkPoint to, size_t first) {
+  float sweepX = to.fX - from.fX;
+  float sweepY = to.fY - from.fY;
+
+  for (size_t i = first; i < segments.size(); i++) {
+    float startX = segments.startX[i], startY = segments.startY[i];
+    float dx = segments.endX[i] - startX;
+    float dy = segments.endY[i] - startY;
+
+    float startSide = sweepX * (startY - from.fY) - sweepY * (startX - from.fX);
+    float endSide = sweepX * (segments.endY[i] - from.fY) -
+                    sweepY * (segments.endX[i] - from.fX);
+    float fromSide = dx * (from.fY - startY) - dy * (from.fX - startX);
+    float toSide = dx * (to.fY - startY) - dy * (to.fX - startX);
+    if (startSide * endSide < 0 && fromSide * toSide < 0)
+      return i;
+
+    float distance = std::min(
+        std::min(distanceSquared(from.fX - startX, from.fY - startY, dx, dy),
+                 distanceSquared(to.fX - startX, to.fY - startY, dx, dy)),
+        std::min(distanceSquared(startX - from.fX, startY - from.fY, sweepX,
+                                 sweepY),
+                 distanceSquared(segments.endX[i] - from.fX,
+                                 segments.endY[i] - from.fY, sweepX,
+                                 sweepY)));
+    if (distance <= segments.radiusSquared[i])
+      return i;
+  }
+
+  return NO_HIT;
+}
+
+#ifdef IPEN_X86
+__attribute__((target("sse2"))) static inline __m128
+distanceSquared4(__m128 px, __m128 py, __m128 dx, __m128 dy) {
+  __m128 lengthSquared =
+      _mm_max_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)),
+                 _mm_set1_ps(FLT_MIN));
+  __m128 t = _mm_div_ps(_mm_add_ps(_mm_mul_ps(px, dx), _mm_mul_ps(py, dy)),
+                        lengthSquared);
+  t = _mm_min_ps(_mm_max_ps(t, _mm_setzero_ps()), _mm_set1_ps(1));
+
+  __m128 cx = _mm_sub_ps(px, _mm_mul_ps(t, dx));
+  __m128 cy = _mm_sub_ps(py, _mm_mul_ps(t, dy));
+  return _mm_add_ps(_mm_mul_ps(cx, cx), _mm_mul_ps(cy, cy));
+}
+
+__attribute__((target("sse2"))) static inline __m128
+cross4(__m128 ax, __m128 ay, __m128 bx, __m128 by) {
+  return _mm_sub_ps(_mm_mul_ps(ax, by), _mm_mul_ps(ay, bx));
+}
+
+__attribute__((target("sse2"))) static size_t
+firstHitSse2(HitSegments &segments, float x, float y, size_t first) {
+  const __m128 pointX = _mm_set1_ps(x);
+  const __m128 pointY = _mm_set1_ps(y);
+
+  size_t count = segments.size();
+  size_t i = first;
+  for (; i + 4 <= count; i += 4) {
+    __m128 startX = _mm_loadu_ps(segments.startX.data() + i);
+    __m128 startY = _mm_loadu_ps(segments.startY.data() + i);
+    __m128 dx = _mm_sub_ps(_mm_loadu_ps(segments.endX.data() + i), startX);
+    __m128 dy = _mm_sub_ps(_mm_loadu_ps(segments.endY.data() + i), startY);
+
+    __m128 distance = distanceSquared4(_mm_sub_ps(pointX, startX),
+                                       _mm_sub_ps(pointY, startY), dx, dy);
+    __m128 radius = _mm_loadu_ps(segments.radiusSquared.data() + i);
+    int hits = _mm_movemask_ps(_mm_cmple_ps(distance, radius));
+    if (hits)
+      return i + __builtin_ctz(hits);
+  }
+
+  return firstHitScalar(segments, x, y, i);
+}
+
+__attribute__((target("sse2"))) static size_t
+firstSweptHitSse2(HitSegments &segments, SkPoint from, SkPoint to,
+                  size_t first) {
+  const __m128 fromX = _mm_set1_ps(from.fX);
+  const __m128 fromY = _mm_set1_ps(from.fY);
+  const __m128 toX = _mm_set1_ps(to.fX);
+  const __m128 toY = _mm_set1_ps(to.fY);
+  const __m128 sweepX = _mm_set1_ps(to.fX - from.fX);
+  const __m128 sweepY = _mm_set1_ps(to.fY - from.fY);
+  const __m128 zero = _mm_setzero_ps();
+
+  size_t count = segments.size();
+  size_t i = first;
+  for (; i + 4 <= count; i += 4) {
+    __m128 startX = _mm_loadu_ps(segments.startX.data() + i);
+    __m128 startY = _mm_loadu_ps(segments.startY.data() + i);
+    __m128 endX = _mm_loadu_ps(segments.endX.data() + i);
+    __m128 endY = _mm_loadu_ps(segments.endY.data() + i);
+    __m128 dx = _mm_sub_ps(endX, startX);
+    __m128 dy = _mm_sub_ps(endY, startY);
+
+    __m128 startSide = cross4(sweepX, sweepY, _mm_sub_ps(startX, fromX),
+                              _mm_sub_ps(startY, fromY));
+    __m128 endSide = cross4(sweepX, sweepY, _mm_sub_ps(endX, fromX),
+                            _mm_sub_ps(endY, fromY));
+    __m128 fromSide = cross4(dx, dy, _mm_sub_ps(fromX, startX),
+                             _mm_sub_ps(fromY, startY));
+    __m128 toSide =
+        cross4(dx, dy, _mm_sub_ps(toX, startX), _mm_sub_ps(toY, startY));
+    __m128 isCrossing =
+        _mm_and_ps(_mm_cmplt_ps(_mm_mul_ps(startSide, endSide), zero),
+                   _mm_cmplt_ps(_mm_mul_ps(fromSide, toSide), zero));
+
+    __m128 distance = _mm_min_ps(
+        _mm_min_ps(distanceSquared4(_mm_sub_ps(fromX, startX),
+                                    _mm_sub_ps(fromY, startY), dx, dy),
+                   distanceSquared4(_mm_sub_ps(toX, startX),
+                                    _mm_sub_ps(toY, startY), dx, dy)),
+        _mm_min_ps(distanceSquared4(_mm_sub_ps(startX, fromX),
+                                    _mm_sub_ps(startY, fromY), sweepX,
+                                    sweepY),
+                   distanceSquared4(_mm_sub_ps(endX, fromX),
+                                    _mm_sub_ps(endY, fromY), sweepX,
+                                    sweepY)));
+
+    __m128 radius = _mm_loadu_ps(segments.radiusSquared.data() + i);
+    __m128 isHit = _mm_or_ps(isCrossing, _mm_cmple_ps(distance, radius));
+    int hits = _mm_movemask_ps(isHit);
+    if (hits)
+      return i + __builtin_ctz(hits);
+  }
+
+  return firstSweptHitScalar(segments, from, to, i);
+}
+
+__attribute__((target("avx2"))) static inline __m256
+distanceSquared8(__m256 px, __m256 py, __m256 dx, __m256 dy) {
+  __m256 lengthSquared = _mm256_max_ps(
+      _mm256_add_ps(_mm256_mul_ps(dx, dx), _mm256_mul_ps(dy, dy)),
+      _mm256_set1_ps(FLT_MIN));
+  __m256 t = _mm256_div_ps(
+      _mm256_add_ps(_mm256_mul_ps(px, dx), _mm256_mul_ps(py, dy)),
+      lengthSquared);
+  t = _mm256_min_ps(_mm256_max_ps(t, _mm256_setzero_ps()),
+                    _mm256_set1_ps(1));
+
+  __m256 cx = _mm256_sub_ps(px, _mm256_mul_ps(t, dx));
+  __m256 cy = _mm256_sub_ps(py, _mm256_mul_ps(t, dy));
+  return _mm256_add_ps(_mm256_mul_ps(cx, cx), _mm256_mul_ps(cy, cy));
+}
+
+__attribute__((target("avx2"))) static inline __m256
+cross8(__m256 ax, __m256 ay, __m256 bx, __m256 by) {
+  return _mm256_sub_ps(_mm256_mul_ps(ax, by), _mm256_mul_ps(ay, bx));
+}
+
+__attribute__((target("avx2"))) static size_t
+firstHitAvx2(HitSegments &segments, float x, float y, size_t first) {
+  const __m256 pointX = _mm256_set1_ps(x);
+  const __m256 pointY = _mm256_set1_ps(y);
+
+  size_t count = segments.size();
+  size_t i = first;
+  for (; i + 8 <= count; i += 8) {
+    __m256 startX = _mm256_loadu_ps(segments.startX.data() + i);
+    __m256 startY = _mm256_loadu_ps(segments.startY.data() + i);
+    __m256 dx =
+        _mm256_sub_ps(_mm256_loadu_ps(segments.endX.data() + i), startX);
+    __m256 dy =
+        _mm256_sub_ps(_mm256_loadu_ps(segments.endY.data() + i), startY);
+
+    __m256 distance = distanceSquared8(_mm256_sub_ps(pointX, startX),
+                                       _mm256_sub_ps(pointY, startY), dx, dy);
+    __m256 radius = _mm256_loadu_ps(segments.radiusSquared.data() + i);
+    int hits =
+        _mm256_movemask_ps(_mm256_cmp_ps(distance, radius, _CMP_LE_OQ));
+    if (hits)
+      return i + __builtin_ctz(hits);
+  }
+
+  return firstHitScalar(segments, x, y, i);
+}
+
+__attribute__((target("avx2"))) static size_t
+firstSweptHitAvx2(HitSegments &segments, SkPoint from, SkPoint to,
+                  size_t first) {
+  const __m256 fromX = _mm256_set1_ps(from.fX);
+  const __m256 fromY = _mm256_set1_ps(from.fY);
+  const __m256 toX = _mm256_set1_ps(to.fX);
+  const __m256 toY = _mm256_set1_ps(to.fY);
+  const __m256 sweepX = _mm256_set1_ps(to.fX - from.fX);
+  const __m256 sweepY = _mm256_set1_ps(to.fY - from.fY);
+  const __m256 zero = _mm256_setzero_ps();
+
+  size_t count = segments.size();
+  size_t i = first;
+  for (; i + 8 <= count; i += 8) {
+    __m256 startX = _mm256_loadu_ps(segments.startX.data() + i);
+    __m256 startY = _mm256_loadu_ps(segments.startY.data() + i);
+    __m256 endX = _mm256_loadu_ps(segments.endX.data() + i);
+    __m256 endY = _mm256_loadu_ps(segments.endY.data() + i);
+    __m256 dx = _mm256_sub_ps(endX, startX);
+    __m256 dy = _mm256_sub_ps(endY, startY);
+
+    __m256 startSide = cross8(sweepX, sweepY, _mm256_sub_ps(startX, fromX),
+                              _mm256_sub_ps(startY, fromY));
+    __m256 endSide = cross8(sweepX, sweepY, _mm256_sub_ps(endX, fromX),
+                            _mm256_sub_ps(endY, fromY));
+    __m256 fromSide = cross8(dx, dy, _mm256_sub_ps(fromX, startX),
+                             _mm256_sub_ps(fromY, startY));
+    __m256 toSide = cross8(dx, dy, _mm256_sub_ps(toX, startX),
+                           _mm256_sub_ps(toY, startY));
+    __m256 isCrossing = _mm256_and_ps(
+        _mm256_cmp_ps(_mm256_mul_ps(startSide, endSide), zero, _CMP_LT_OQ),
+        _mm256_cmp_ps(_mm256_mul_ps(fromSide, toSide), zero, _CMP_LT_OQ));
+
+    __m256 distance = _mm256_min_ps(
+        _mm256_min_ps(distanceSquared8(_mm256_sub_ps(fromX, startX),
+                                       _mm256_sub_ps(fromY, startY), dx, dy),
+                      distanceSquared8(_mm256_sub_ps(toX, startX),
+                                       _mm256_sub_ps(toY, startY), dx, dy)),
+        _mm256_min_ps(distanceSquared8(_mm256_sub_ps(startX, fromX),
+                                       _mm256_sub_ps(startY, fromY), sweepX,
+                                       sweepY),
+                      distanceSquared8(_mm256_sub_ps(endX, fromX),
+                                       _mm256_sub_ps(endY, fromY), sweepX,
+                                       sweepY)));
+
+    __m256 radius = _mm256_loadu_ps(segments.radiusSquared.data() + i);
+    __m256 isHit = _mm256_or_ps(
+        isCrossing, _mm256_cmp_ps(distance, radius, _CMP_LE_OQ));
+    int hits = _mm256_movemask_ps(isHit);
+    if (hits)
+      return i + __builtin_ctz(hits);
+  }
+
+  return firstSweptHitScalar(segments, from, to, i);
+}
+#endif
+
+bool isHitKernelSupported(HitKernel kernel) {
+  switch (kernel) {
+  case HIT_SCALAR:
+    return true;
+#ifdef IPEN_X86
+  case HIT_SSE2:
+    return __builtin_cpu_supports("sse2");
+  case HIT_AVX2:
+    return __builtin_cpu_supports("avx2");
+#endif
+  default:
+    return false;
+  }
+}
+
+HitKernel bestHitKernel() {
+  static const HitKernel best = isHitKernelSupported(HIT_AVX2)   ? HIT_AVX2
+                                : isHitKernelSupported(HIT_SSE2) ? HIT_SSE2
+                                                                 : HIT_SCALAR;
+  return best;
+}
+
+size_t firstHit(HitSegments &segments, SkPoint point, size_t first) {
+  return firstHit(segments, point, first, bestHitKernel());
+}
+
+size_t firstHit(HitSegments &segments, SkPoint point, size_t first,
+                HitKernel kernel) {
+  switch (kernel) {
+#ifdef IPEN_X86
+  case HIT_AVX2:
+    return firstHitAvx2(segments, point.fX, point.fY, first);
+  case HIT_SSE2:
+    return firstHitSse2(segments, point.fX, point.fY, first);
+#endif
+  default:
+    return firstHitScalar(segments, point.fX, point.fY, first);
+  }
+}
+
+size_t firstSweptHit(HitSegments &segments, SkPoint from, SkPoint to,
+                     size_t first) {
+  return firstSweptHit(segments, from, to, first, bestHitKernel());
+}
+
+size_t firstSweptHit(HitSegments &segments, SkPoint from, SkPoint to,
+                     size_t first, HitKernel kernel) {
+  switch (kernel) {
+#ifdef IPEN_X86
+  case HIT_AVX2:
+    return firstSweptHitAvx2(segments, from, to, first);
+  case HIT_SSE2:
+    return firstSweptHitSse2(segments, from, to, first);
+#endif
+  default:
+    return firstSweptHitScalar(segments, from, to, first);
+  }
+}
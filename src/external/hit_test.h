@@ -0,0 +1,54 @@
+// Copyright (c) 2024 DavidDeadly
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "include/core/SkPoint.h"
+
+#include "curves.h"
+
+const size_t NO_HIT = SIZE_MAX;
+
+enum HitKernel {
+  HIT_SCALAR,
+  HIT_SSE2,
+  HIT_AVX2,
+};
+
+// Segments to test a point against, as a struct of arrays so a kernel
+// loads the same coordinate of several segments at once. Each one has the
+// radius it is hit within, squared, and an owner the caller picks, like the
+// candidate it came from.
+struct HitSegments {
+  std::vector<float> startX;
+  std::vector<float> startY;
+  std::vector<float> endX;
+  std::vector<float> endY;
+  std::vector<float> radiusSquared;
+  std::vector<uint32_t> owners;
+
+  size_t size() { return this->owners.size(); }
+  void clear();
+  void add(SkPoint start, SkPoint end, float radius, uint32_t owner);
+  // as the chords the curve is measured over
+  void addCurve(const StrokeCurve &curve, float radius, uint32_t owner);
+};
+
+// The fastest kernel the CPU supports, picked on first use
+HitKernel bestHitKernel();
+bool isHitKernelSupported(HitKernel kernel);
+
+// Index of the first segment from the given one on that the point is
+// within the radius of, NO_HIT when there is none. Kernels find the same
+// hit, the vector ones test a block of segments at a time.
+size_t firstHit(HitSegments &segments, SkPoint point, size_t first);
+size_t firstHit(HitSegments &segments, SkPoint point, size_t first,
+                HitKernel kernel);
+// Same for the capsule swept by a point moving from one position to the
+// next, with the distance between the segments
+size_t firstSweptHit(HitSegments &segments, SkPoint from, SkPoint to,
+                     size_t first);
+size_t firstSweptHit(HitSegments &segments, SkPoint from, SkPoint to,
+                     size_t first, HitKernel kernel);
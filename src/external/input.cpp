@@ -0,0 +1,62 @@
+// Copyright (c) 2024 DavidDeadly
+#include "input.h"
+
+#include <chrono>
+
+#include "log.h"
+
+uint64_t inputTimestamp() {
+  auto now = std::chrono::steady_clock::now().time_since_epoch();
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(now).count();
+}
+
+void pushSample(InputQueue &queue, const InputSample &sample) {
+  while (!queue.push(sample))
+    std::this_thread::yield();
+}
+
+bool pushSample(InputQueue &queue, const InputSample &sample,
+                const std::atomic<bool> &running) {
+  while (!queue.push(sample)) {
+    if (!running)
+      return false;
+
+    std::this_thread::yield();
+  }
+
+  return true;
+}
+
+InputThread::InputThread(IInputSource *source) { this->source = source; }
+
+InputThread::~InputThread() {
+  this->stop();
+  delete this->source;
+}
+
+void InputThread::start(int width, int height,
+                        std::function<void()> notify) {
+  if (this->worker)
+    return;
+
+  this->source->setArea(width, height);
+
+  this->worker = new std::thread([this, notify]() {
+    LOG_INFO("input", "Listening for input on its own thread");
+
+    this->source->run(this->queue, notify);
+  });
+}
+
+void InputThread::stop() {
+  if (!this->worker)
+    return;
+
+  this->source->stop();
+
+  if (this->worker->joinable())
+    this->worker->join();
+
+  delete this->worker;
+  this->worker = NULL;
+}
@@ -0,0 +1,68 @@
+// Copyright (c) 2024 DavidDeadly
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <thread>
+
+#include "spsc_queue.h"
+
+enum InputTool : uint8_t {
+  TOOL_NONE,
+  TOOL_PEN,
+  TOOL_ERASER,
+};
+
+// State of the pointer at one instant, in window coordinates
+struct InputSample {
+  uint64_t timestamp; // steady clock, nanoseconds
+  float x;
+  float y;
+  float pressure;
+  float tiltX;
+  float tiltY;
+  InputTool tool;
+  bool isDown;
+  bool isTablet; // the system cursor mirrors tablets, this tells them apart
+};
+
+const size_t INPUT_QUEUE_SIZE = 4096;
+typedef SpscQueue<InputSample, INPUT_QUEUE_SIZE> InputQueue;
+
+uint64_t inputTimestamp();
+
+class IInputSource {
+public:
+  virtual ~IInputSource() = default;
+
+  // Window area device coordinates are mapped to
+  virtual void setArea(int width, int height) = 0;
+
+  // Produces samples until stop() is called, on the input thread
+  virtual void run(InputQueue &queue, std::function<void()> notify) = 0;
+  virtual void stop() = 0;
+};
+
+// Samples a source on its own thread, so pen input keeps its native rate
+// whatever the render loop is doing
+class InputThread {
+private:
+  IInputSource *source;
+  std::thread *worker = NULL;
+
+public:
+  InputQueue queue;
+
+  InputThread(IInputSource *source);
+  ~InputThread();
+
+  void start(int width, int height, std::function<void()> notify);
+  void stop();
+};
+
+// Waits for room instead of dropping the sample when the consumer is behind
+void pushSample(InputQueue &queue, const InputSample &sample);
+// Same, but gives up once the source is stopped, the consumer may be gone
+bool pushSample(InputQueue &queue, const InputSample &sample,
+                const std::atomic<bool> &running);
@@ -0,0 +1,287 @@
+// Copyright (c) 2024 DavidDeadly
+#include "journal.h"
+
+#include <cstddef>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "log.h"
+#include "stroke_file.h"
+
+const size_t REPLAY_CHUNK = 4096; // records read at once
+
+// FNV-1a over everything but the checksum itself
+static uint32_t checksumOf(const JournalRecord &record) {
+  const uint8_t *bytes = (const uint8_t *)&record;
+  uint32_t hash = 2166136261u;
+
+  for (size_t i = 0; i < offsetof(JournalRecord, checksum); i++) {
+    hash ^= bytes[i];
+    hash *= 16777619u;
+  }
+
+  return hash;
+}
+
+static bool writeAll(int file, const void *data, size_t size) {
+  const uint8_t *bytes = (const uint8_t *)data;
+
+  while (size > 0) {
+    ssize_t written = ::write(file, bytes, size);
+    if (written < 0)
+      return false;
+
+    bytes += written;
+    size -= written;
+  }
+
+  return true;
+}
+
+Journal::Journal(const char *path) {
+  int file = open(path, O_RDWR | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+  if (file < 0) {
+    LOG_ERROR("journal", "Failed to open journal: %s", path);
+    return;
+  }
+
+  struct stat info;
+  if (fstat(file, &info) != 0) {
+    close(file);
+    return;
+  }
+
+  if (info.st_size == 0) {
+    bool isCreated = writeAll(file, JOURNAL_MAGIC, sizeof(JOURNAL_MAGIC)) &&
+                     fsync(file) == 0;
+    if (!isCreated) {
+      LOG_ERROR("journal", "Failed to create journal: %s", path);
+      close(file);
+      return;
+    }
+  } else {
+    char magic[sizeof(JOURNAL_MAGIC)];
+    bool hasMagic = pread(file, magic, sizeof(magic), 0) == sizeof(magic) &&
+                    memcmp(magic, JOURNAL_MAGIC, sizeof(magic)) == 0;
+    if (!hasMagic) {
+      LOG_ERROR("journal", "Invalid journal: %s", path);
+      close(file);
+      return;
+    }
+  }
+
+  this->file = file;
+  this->validSize = sizeof(JOURNAL_MAGIC);
+}
+
+Journal::~Journal() {
+  {
+    std::lock_guard<std::mutex> guard(this->lock);
+    this->running = false;
+  }
+  this->wakeUp.notify_one();
+
+  if (this->writer) {
+    this->writer->join();
+    delete this->writer;
+  }
+
+  if (this->file >= 0)
+    close(this->file);
+}
+
+// Stops at the first record that is cut short or doesn't match its
+// checksum, what a crash in the middle of a write leaves behind
+uint64_t Journal::replay(uint64_t after,
+                         std::function<void(const JournalRecord &)> apply) {
+  this->compactedAt = after;
+  if (!this->isOpen())
+    return after;
+
+  std::vector<JournalRecord> chunk(REPLAY_CHUNK);
+  uint64_t last = after;
+  size_t offset = sizeof(JOURNAL_MAGIC);
+  size_t replayed = 0;
+
+  while (true) {
+    ssize_t bytes = pread(this->file, chunk.data(),
+                          chunk.size() * sizeof(JournalRecord), offset);
+    if (bytes <= 0)
+      break;
+
+    size_t count = bytes / sizeof(JournalRecord);
+    size_t valid = 0;
+    while (valid < count && checksumOf(chunk[valid]) == chunk[valid].checksum)
+      valid++;
+
+    for (size_t i = 0; i < valid; i++) {
+      if (chunk[i].sequence <= last)
+        continue;
+
+      apply(chunk[i]);
+      last = chunk[i].sequence;
+      replayed++;
+    }
+
+    offset += valid * sizeof(JournalRecord);
+    if (valid < chunk.size())
+      break;
+  }
+
+  this->validSize = offset;
+  if (replayed > 0)
+    LOG_INFO("journal", "Replayed %zu operations", replayed);
+
+  return last;
+}
+
+void Journal::start(uint64_t lastSequence) {
+  if (!this->isOpen() || this->writer)
+    return;
+
+  // drop whatever a crash left after the last whole record
+  if (ftruncate(this->file, this->validSize) != 0)
+    LOG_WARNING("journal", "Failed to drop the journal's torn tail");
+
+  this->sequence = lastSequence;
+  this->writer = new std::thread([this]() { this->run(); });
+}
+
+void Journal::append(JournalOp op, float x, float y, float pressure,
+                     uint32_t color) {
+  if (!this->writer)
+    return;
+
+  JournalRecord record = {};
+  record.sequence = ++this->sequence;
+  record.op = op;
+  record.x = x;
+  record.y = y;
+  record.pressure = pressure;
+  record.color = color;
+  record.checksum = checksumOf(record);
+
+  {
+    std::lock_guard<std::mutex> guard(this->lock);
+    this->pending.push_back(record);
+  }
+  this->wakeUp.notify_one();
+}
+
+// The snapshot is encoded by the caller with its blocks uncompressed, the
+// writer thread compresses them, puts it on disk and then empties the
+// journal
+void Journal::compact(const char *drawingPath, std::vector<uint8_t> &&bytes) {
+  if (!this->writer)
+    return;
+
+  {
+    std::lock_guard<std::mutex> guard(this->lock);
+    this->snapshotPath = drawingPath;
+    this->snapshot = std::move(bytes);
+    this->snapshotSequence = this->sequence;
+    this->hasSnapshot = true;
+  }
+  this->wakeUp.notify_one();
+
+  this->compactedAt = this->sequence;
+}
+
+bool Journal::flush() {
+  std::unique_lock<std::mutex> guard(this->lock);
+  this->idle.wait(guard, [this]() {
+    return this->pending.empty() && !this->hasSnapshot && !this->isWriting;
+  });
+
+  bool hasFailed = this->hasFailed;
+  this->hasFailed = false;
+
+  return !hasFailed;
+}
+
+bool Journal::write(const std::vector<JournalRecord> &records,
+                    uint64_t after) {
+  size_t first = 0;
+  while (first < records.size() && records[first].sequence <= after)
+    first++;
+
+  if (first == records.size())
+    return true;
+
+  bool isWritten =
+      writeAll(this->file, records.data() + first,
+               (records.size() - first) * sizeof(JournalRecord)) &&
+      fdatasync(this->file) == 0;
+  if (!isWritten)
+    LOG_ERROR("journal", "Failed to write %zu operations",
+              records.size() - first);
+
+  return isWritten;
+}
+
+// Once the snapshot is renamed into place every record up to its sequence
+// is in it. A crash before the journal is emptied only leaves records the
+// next replay skips.
+bool Journal::saveSnapshot(const std::string &path,
+                           std::vector<uint8_t> &&bytes, uint64_t sequence,
+                           const std::vector<JournalRecord> &records) {
+  if (!writeStrokeFile(path.c_str(), compressBlocks(std::move(bytes))))
+    return false;
+
+  // failing to empty it only leaves records the next replay skips
+  if (ftruncate(this->file, sizeof(JOURNAL_MAGIC)) != 0) {
+    LOG_WARNING("journal", "Failed to empty the journal");
+    return true;
+  }
+
+  LOG_DEBUG("journal", "Compacted into %s", path.c_str());
+
+  // records made after the snapshot was taken but written along with it
+  return this->write(records, sequence);
+}
+
+void Journal::run() {
+  std::vector<JournalRecord> batch;
+  std::vector<uint8_t> snapshot;
+  std::string snapshotPath;
+
+  std::unique_lock<std::mutex> guard(this->lock);
+  while (true) {
+    this->wakeUp.wait(guard, [this]() {
+      return !this->pending.empty() || this->hasSnapshot || !this->running;
+    });
+
+    if (this->pending.empty() && !this->hasSnapshot)
+      break;
+
+    // group commit: everything appended since the last sync goes at once
+    batch.swap(this->pending);
+    bool isSnapshot = this->hasSnapshot;
+    uint64_t snapshotSequence = this->snapshotSequence;
+    if (isSnapshot) {
+      snapshot.swap(this->snapshot);
+      snapshotPath.swap(this->snapshotPath);
+      this->hasSnapshot = false;
+    }
+
+    this->isWriting = true;
+    guard.unlock();
+
+    bool isWritten = this->write(batch, 0);
+    if (isSnapshot)
+      isWritten = this->saveSnapshot(snapshotPath, std::move(snapshot),
+                                     snapshotSequence, batch) &&
+                  isWritten;
+
+    batch.clear();
+    snapshot.clear();
+    snapshot.shrink_to_fit();
+
+    guard.lock();
+    this->hasFailed = this->hasFailed || !isWritten;
+    this->isWriting = false;
+    this->idle.notify_all();
+  }
+}
@@ -0,0 +1,98 @@
+// Copyright (c) 2024 DavidDeadly
+#pragma once
+
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+enum JournalOp : uint8_t {
+  JOURNAL_BEGIN,
+  JOURNAL_POINT,
+  JOURNAL_END,
+  JOURNAL_CANCEL,
+  JOURNAL_ERASE,
+  JOURNAL_UNDO,
+  JOURNAL_REDO,
+  JOURNAL_RESET,
+  JOURNAL_COLOR,
+  JOURNAL_ERASE_END,
+};
+
+// A drawing operation as it was called, replaying them in order rebuilds
+// the same strokes
+struct __attribute__((packed)) JournalRecord {
+  uint64_t sequence;
+  JournalOp op;
+  float x;
+  float y;
+  float pressure;
+  uint32_t color;
+  uint32_t checksum; // of the fields above, a torn write doesn't match
+};
+
+// Journals are this magic followed by records
+const char JOURNAL_MAGIC[8] = {'I', 'P', 'E', 'N', 'J', 'R', 'N', '1'};
+
+// Write-ahead log of the operations made since the drawing was last saved.
+// Records are handed to a writer thread that appends and syncs whatever
+// piled up since its last sync at once, so the render thread never waits on
+// the disk. Compacting saves a snapshot of the drawing, tagged with the last
+// record it includes, and empties the journal. The snapshot is compressed
+// on the writer thread too.
+class Journal {
+private:
+  int file = -1;
+  uint64_t sequence = 0;
+  uint64_t compactedAt = 0;
+  size_t validSize = 0;
+
+  std::mutex lock;
+  std::condition_variable wakeUp;
+  std::condition_variable idle;
+  bool running = true;
+  bool isWriting = false;
+  bool hasFailed = false; // since the last flush
+  std::vector<JournalRecord> pending;
+
+  std::string snapshotPath;
+  std::vector<uint8_t> snapshot;
+  uint64_t snapshotSequence = 0;
+  bool hasSnapshot = false;
+
+  std::thread *writer = NULL;
+
+  void run();
+  bool write(const std::vector<JournalRecord> &records, uint64_t after);
+  bool saveSnapshot(const std::string &path, std::vector<uint8_t> &&bytes,
+                    uint64_t sequence,
+                    const std::vector<JournalRecord> &records);
+
+public:
+  Journal(const char *path);
+  ~Journal();
+
+  bool isOpen() { return this->file >= 0; }
+
+  // records after a sequence, those before it are in the saved drawing;
+  // returns the last sequence seen
+  uint64_t replay(uint64_t after,
+                  std::function<void(const JournalRecord &)> apply);
+  // starts appending after the replayed records
+  void start(uint64_t lastSequence);
+
+  void append(JournalOp op, float x, float y, float pressure,
+              uint32_t color);
+  uint64_t lastSequence() { return this->sequence; }
+  uint64_t recordsSinceCompaction() {
+    return this->sequence - this->compactedAt;
+  }
+
+  void compact(const char *drawingPath, std::vector<uint8_t> &&bytes);
+  // waits until everything appended is on disk, false if some of it
+  // couldn't be written since the last flush
+  bool flush();
+};
@@ -0,0 +1,366 @@
+// Copyright (c) 2024 DavidDeadly
+#include "layer_tiles.h"
+
+#include <algorithm>
+#include <cmath>
+
+#include "include/core/SkImageInfo.h"
+#include "include/core/SkPixmap.h"
+#include "include/core/SkSamplingOptions.h"
+
+void LayerTiles::init(SkSurface *target, int width, int height,
+                      WorkerPool *pool) {
+  this->pool = pool;
+  this->columns = (width + TILE_SIZE - 1) / TILE_SIZE;
+  this->rows = (height + TILE_SIZE - 1) / TILE_SIZE;
+  this->tiles.assign(this->columns * this->rows, {});
+
+  for (int row = 0; row < this->rows; row++) {
+    for (int column = 0; column < this->columns; column++) {
+      LayerTile &tile = this->tiles[row * this->columns + column];
+      int left = column * TILE_SIZE;
+      int top = row * TILE_SIZE;
+      int tileWidth = std::min(TILE_SIZE, width - left);
+      int tileHeight = std::min(TILE_SIZE, height - top);
+
+      tile.surface = target->makeSurface(tileWidth, tileHeight).release();
+      if (tile.surface == nullptr)
+        abort();
+
+      tile.surface->getCanvas()->clear(SK_ColorTRANSPARENT);
+      tile.bounds = SkRect::MakeXYWH(left, top, tileWidth, tileHeight);
+    }
+  }
+}
+
+void LayerTiles::cleanUp() {
+  for (auto &tile : this->tiles)
+    delete tile.surface;
+  for (auto &mask : this->masks)
+    for (auto surface : mask.surfaces)
+      delete surface;
+
+  this->tiles.clear();
+  this->damaged.clear();
+  this->masks.clear();
+  this->freeMasks.clear();
+}
+
+// An empty range when the bounds are off the layer
+SkIRect LayerTiles::tilesFor(const SkRect &bounds) {
+  int left = std::floor(bounds.left() / TILE_SIZE);
+  int top = std::floor(bounds.top() / TILE_SIZE);
+  int right = std::floor(bounds.right() / TILE_SIZE);
+  int bottom = std::floor(bounds.bottom() / TILE_SIZE);
+
+  return SkIRect::MakeLTRB(std::max(left, 0), std::max(top, 0),
+                           std::min(right, this->columns - 1),
+                           std::min(bottom, this->rows - 1));
+}
+
+void LayerTiles::add(StrokeId stroke, const SkRect &bounds) {
+  if (stroke >= this->orders.size())
+    this->orders.resize(stroke + 1);
+
+  this->orders[stroke] = this->nextOrder++;
+  this->insert(stroke, bounds);
+}
+
+// Mostly appended, the stroke put back goes where its order says
+void LayerTiles::insert(StrokeId stroke, const SkRect &bounds) {
+  SkIRect range = this->tilesFor(bounds);
+  uint64_t order = this->orders[stroke];
+
+  for (int row = range.top(); row <= range.bottom(); row++) {
+    for (int column = range.left(); column <= range.right(); column++) {
+      std::vector<StrokeId> &strokes =
+          this->tiles[row * this->columns + column].strokes;
+
+      auto position = strokes.end();
+      while (position != strokes.begin() &&
+             this->orders[*(position - 1)] > order)
+        position--;
+
+      strokes.insert(position, stroke);
+    }
+  }
+}
+
+void LayerTiles::insertAt(StrokeId stroke, const SkRect &bounds,
+                          StrokeId sibling) {
+  if (stroke >= this->orders.size())
+    this->orders.resize(stroke + 1);
+
+  this->orders[stroke] = this->orders[sibling];
+  this->insert(stroke, bounds);
+}
+
+void LayerTiles::remove(StrokeId stroke, const SkRect &bounds) {
+  SkIRect range = this->tilesFor(bounds);
+
+  for (int row = range.top(); row <= range.bottom(); row++)
+    for (int column = range.left(); column <= range.right(); column++)
+      std::erase(this->tiles[row * this->columns + column].strokes, stroke);
+}
+
+// Masks are only hidden, what cleared them can bring them back
+void LayerTiles::clear() {
+  for (auto &mask : this->masks)
+    mask.isShown = false;
+
+  for (auto &tile : this->tiles) {
+    tile.strokes.clear();
+    tile.masks.clear();
+    tile.damage.setEmpty();
+    tile.surface->getCanvas()->clear(SK_ColorTRANSPARENT);
+  }
+
+  this->damaged.clear();
+}
+
+MaskId LayerTiles::addMask() {
+  MaskId mask = this->masks.size();
+  if (!this->freeMasks.empty()) {
+    mask = this->freeMasks.back();
+    this->freeMasks.pop_back();
+  } else {
+    this->masks.emplace_back();
+    this->maskOrders.push_back(0);
+  }
+
+  this->masks[mask].isShown = true;
+  this->maskOrders[mask] = this->nextOrder++;
+  return mask;
+}
+
+// Made and listed in its tile the first time the mask reaches it. Masks
+// stay in memory whatever the tiles are on, so saving them never waits on
+// the GPU.
+SkSurface *LayerTiles::maskSurface(MaskId mask, uint32_t tile) {
+  LayerMask &layerMask = this->masks[mask];
+  auto position =
+      std::find(layerMask.tiles.begin(), layerMask.tiles.end(), tile);
+  if (position != layerMask.tiles.end())
+    return layerMask.surfaces[position - layerMask.tiles.begin()];
+
+  SkSurface *tileSurface = this->tiles[tile].surface;
+  SkImageInfo info =
+      SkImageInfo::MakeA8(tileSurface->width(), tileSurface->height());
+  SkSurface *surface = SkSurfaces::Raster(info).release();
+  if (surface == nullptr)
+    abort();
+
+  surface->getCanvas()->clear(SK_ColorTRANSPARENT);
+  layerMask.tiles.push_back(tile);
+  layerMask.surfaces.push_back(surface);
+
+  if (layerMask.isShown)
+    this->stackMask(mask, tile, surface);
+
+  return surface;
+}
+
+void LayerTiles::stackMask(MaskId mask, uint32_t tile, SkSurface *surface) {
+  std::vector<TileMask> &tileMasks = this->tiles[tile].masks;
+  uint64_t order = this->maskOrders[mask];
+
+  auto position = tileMasks.end();
+  while (position != tileMasks.begin() &&
+         this->maskOrders[(position - 1)->mask] > order)
+    position--;
+
+  tileMasks.insert(position, {mask, surface});
+}
+
+void LayerTiles::paintMask(
+    MaskId mask, const SkRect &bounds,
+    const std::function<void(SkCanvas *, SkBlendMode)> &drawCoverage) {
+  this->masks[mask].bounds.join(bounds);
+  SkIRect range = this->tilesFor(bounds);
+
+  for (int row = range.top(); row <= range.bottom(); row++) {
+    for (int column = range.left(); column <= range.right(); column++) {
+      uint32_t index = row * this->columns + column;
+      LayerTile &tile = this->tiles[index];
+      SkCanvas *maskCanvas = this->maskSurface(mask, index)->getCanvas();
+      SkCanvas *tileCanvas = tile.surface->getCanvas();
+
+      maskCanvas->save();
+      maskCanvas->translate(-tile.bounds.left(), -tile.bounds.top());
+      drawCoverage(maskCanvas, SkBlendMode::kSrcOver);
+      maskCanvas->restore();
+
+      tileCanvas->save();
+      tileCanvas->translate(-tile.bounds.left(), -tile.bounds.top());
+      drawCoverage(tileCanvas, SkBlendMode::kDstOut);
+      tileCanvas->restore();
+    }
+  }
+}
+
+void LayerTiles::applyMask(SkCanvas *canvas, const LayerTile &tile,
+                           SkSurface *mask) {
+  SkPaint erase;
+  erase.setBlendMode(SkBlendMode::kDstOut);
+  mask->draw(canvas, tile.bounds.left(), tile.bounds.top(),
+             SkSamplingOptions(), &erase);
+}
+
+void LayerTiles::showMask(MaskId mask) {
+  LayerMask &layerMask = this->masks[mask];
+  layerMask.isShown = true;
+
+  for (size_t i = 0; i < layerMask.tiles.size(); i++)
+    this->stackMask(mask, layerMask.tiles[i], layerMask.surfaces[i]);
+
+  this->invalidate(layerMask.bounds);
+}
+
+void LayerTiles::hideMask(MaskId mask) {
+  LayerMask &layerMask = this->masks[mask];
+  layerMask.isShown = false;
+
+  for (const auto tile : layerMask.tiles)
+    std::erase_if(this->tiles[tile].masks, [mask](const TileMask &tileMask) {
+      return tileMask.mask == mask;
+    });
+
+  this->invalidate(layerMask.bounds);
+}
+
+void LayerTiles::releaseMask(MaskId mask) {
+  LayerMask &layerMask = this->masks[mask];
+  if (layerMask.isShown)
+    this->hideMask(mask);
+
+  for (auto surface : layerMask.surfaces)
+    delete surface;
+
+  layerMask.tiles.clear();
+  layerMask.surfaces.clear();
+  layerMask.bounds.setEmpty();
+  this->freeMasks.push_back(mask);
+}
+
+size_t LayerTiles::maskBytes(MaskId mask) {
+  size_t bytes = 0;
+  for (auto surface : this->masks[mask].surfaces)
+    bytes += (size_t)surface->width() * surface->height();
+
+  return bytes;
+}
+
+void LayerTiles::readMask(MaskId mask, std::vector<SkIRect> &rects,
+                          std::vector<uint8_t> &coverage) {
+  LayerMask &layerMask = this->masks[mask];
+
+  for (size_t i = 0; i < layerMask.tiles.size(); i++) {
+    SkSurface *surface = layerMask.surfaces[i];
+    SkIRect rect = this->tiles[layerMask.tiles[i]].bounds.round();
+    SkImageInfo info = SkImageInfo::MakeA8(rect.width(), rect.height());
+
+    size_t offset = coverage.size();
+    coverage.resize(offset + info.computeMinByteSize());
+    if (!surface->readPixels(info, coverage.data() + offset, rect.width(), 0,
+                             0)) {
+      coverage.resize(offset);
+      continue;
+    }
+
+    rects.push_back(rect);
+  }
+}
+
+// Saved on a layer of another size, the pixels off it are left out
+void LayerTiles::writeMask(MaskId mask, const SkIRect &rect,
+                           const uint8_t *coverage) {
+  int column = rect.left() / TILE_SIZE;
+  int row = rect.top() / TILE_SIZE;
+  bool isOnLayer = rect.left() % TILE_SIZE == 0 &&
+                   rect.top() % TILE_SIZE == 0 && column < this->columns &&
+                   row < this->rows;
+  if (!isOnLayer)
+    return;
+
+  uint32_t index = row * this->columns + column;
+  LayerTile &tile = this->tiles[index];
+  SkSurface *surface = this->maskSurface(mask, index);
+
+  SkImageInfo info = SkImageInfo::MakeA8(rect.width(), rect.height());
+  surface->writePixels(SkPixmap(info, coverage, rect.width()), 0, 0);
+
+  SkCanvas *tileCanvas = tile.surface->getCanvas();
+  tileCanvas->save();
+  tileCanvas->translate(-tile.bounds.left(), -tile.bounds.top());
+  applyMask(tileCanvas, tile, surface);
+  tileCanvas->restore();
+
+  this->masks[mask].bounds.join(tile.bounds);
+}
+
+void LayerTiles::invalidate(const SkRect &rect) {
+  SkIRect range = this->tilesFor(rect);
+
+  for (int row = range.top(); row <= range.bottom(); row++) {
+    for (int column = range.left(); column <= range.right(); column++) {
+      LayerTile &tile = this->tiles[row * this->columns + column];
+
+      SkRect damage = rect;
+      if (!damage.intersect(tile.bounds))
+        continue;
+
+      if (tile.damage.isEmpty())
+        this->damaged.push_back(&tile);
+      tile.damage.join(damage);
+    }
+  }
+}
+
+void LayerTiles::draw(const SkRect &bounds,
+                      const std::function<void(SkCanvas *)> &drawTile) {
+  SkIRect range = this->tilesFor(bounds);
+
+  for (int row = range.top(); row <= range.bottom(); row++) {
+    for (int column = range.left(); column <= range.right(); column++) {
+      LayerTile &tile = this->tiles[row * this->columns + column];
+      SkCanvas *canvas = tile.surface->getCanvas();
+
+      canvas->save();
+      canvas->translate(-tile.bounds.left(), -tile.bounds.top());
+      drawTile(canvas);
+      canvas->restore();
+    }
+  }
+}
+
+// Damaged tiles share nothing they write to, so they can be repaired on
+// the pool's threads
+void LayerTiles::repair(const std::function<void(LayerTile &)> &repairTile) {
+  std::vector<LayerTile *> &damaged = this->damaged;
+  auto repairDamaged = [&damaged, &repairTile](size_t i) {
+    repairTile(*damaged[i]);
+  };
+
+  if (this->pool)
+    this->pool->run(damaged.size(), repairDamaged);
+  else
+    for (size_t i = 0; i < damaged.size(); i++)
+      repairDamaged(i);
+
+  for (auto tile : damaged)
+    tile->damage.setEmpty();
+  damaged.clear();
+}
+
+void LayerTiles::composite(SkCanvas *canvas, const SkRect &region,
+                           const SkPaint *paint) {
+  SkIRect range = this->tilesFor(region);
+
+  for (int row = range.top(); row <= range.bottom(); row++) {
+    for (int column = range.left(); column <= range.right(); column++) {
+      LayerTile &tile = this->tiles[row * this->columns + column];
+      tile.surface->draw(canvas, tile.bounds.left(), tile.bounds.top(),
+                         SkSamplingOptions(), paint);
+    }
+  }
+}
@@ -0,0 +1,119 @@
+// Copyright (c) 2024 DavidDeadly
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+#include "include/core/SkBlendMode.h"
+#include "include/core/SkCanvas.h"
+#include "include/core/SkPaint.h"
+#include "include/core/SkRect.h"
+#include "include/core/SkSurface.h"
+
+#include "strokes.h"
+#include "worker_pool.h"
+
+const int TILE_SIZE = 256;
+
+typedef uint32_t MaskId;
+const MaskId NO_MASK = UINT32_MAX;
+
+struct TileMask {
+  MaskId mask;
+  SkSurface *surface; // coverage it erases, alpha only
+};
+
+struct LayerTile {
+  SkSurface *surface = nullptr;
+  SkRect bounds;
+  std::vector<StrokeId> strokes; // crossing it, bottom to top
+  std::vector<TileMask> masks;   // erasing it, bottom to top
+  SkRect damage = SkRect::MakeEmpty();
+};
+
+// Pixels erased by one pass of the pixel eraser, only the tiles it went
+// over get a surface
+struct LayerMask {
+  std::vector<uint32_t> tiles;
+  std::vector<SkSurface *> surfaces;
+  SkRect bounds = SkRect::MakeEmpty();
+  bool isShown = false;
+};
+
+// The strokes layer split in fixed tiles, each a surface of its own that
+// knows which strokes cross it, so a change only repaints the tiles it
+// touches and each of them only walks its own strokes. Tiles are drawn in
+// layer coordinates, and repaired in parallel when a pool is given.
+class LayerTiles {
+private:
+  int columns = 0;
+  int rows = 0;
+  std::vector<LayerTile> tiles;
+
+  // strokes are kept in the order they were first stacked, which putting
+  // one back doesn't change
+  std::vector<uint64_t> orders;
+  uint64_t nextOrder = 0;
+
+  std::vector<LayerTile *> damaged;
+  WorkerPool *pool = nullptr;
+
+  std::vector<LayerMask> masks;
+  std::vector<uint64_t> maskOrders;
+  std::vector<MaskId> freeMasks;
+
+  SkIRect tilesFor(const SkRect &bounds);
+  SkSurface *maskSurface(MaskId mask, uint32_t tile);
+  void stackMask(MaskId mask, uint32_t tile, SkSurface *surface);
+
+public:
+  void init(SkSurface *target, int width, int height, WorkerPool *pool);
+  void cleanUp();
+
+  // strokes are listed in every tile their bounds cross
+  void add(StrokeId stroke, const SkRect &bounds);
+  void insert(StrokeId stroke, const SkRect &bounds);
+  // stacked where another stroke is, as the pieces of a stroke cut apart
+  void insertAt(StrokeId stroke, const SkRect &bounds, StrokeId sibling);
+  void remove(StrokeId stroke, const SkRect &bounds);
+  void clear();
+
+  // Masks are stacked over the strokes so far like one more stroke, erasing
+  // them but not the ones stacked after. They are kept apart from the
+  // tiles, which repairing erases again.
+  MaskId addMask();
+  // draws coverage into the mask and erases it from the tiles right away,
+  // each draw with kDstOut, which leaves them as applying the whole mask
+  // would: sharp over the baked strokes
+  void paintMask(
+      MaskId mask, const SkRect &bounds,
+      const std::function<void(SkCanvas *, SkBlendMode)> &drawCoverage);
+  void showMask(MaskId mask);
+  void hideMask(MaskId mask);
+  void releaseMask(MaskId mask);
+  const SkRect &maskBounds(MaskId mask) { return this->masks[mask].bounds; }
+  size_t maskBytes(MaskId mask);
+  bool isBelow(MaskId mask, StrokeId stroke) {
+    return this->maskOrders[mask] < this->orders[stroke];
+  }
+  // erases a mask's coverage from a tile drawn in layer coordinates, as
+  // repairing and loading a mask both do
+  static void applyMask(SkCanvas *canvas, const LayerTile &tile,
+                        SkSurface *mask);
+
+  // in layer pixels, tile by tile, each row by row
+  void readMask(MaskId mask, std::vector<SkIRect> &rects,
+                std::vector<uint8_t> &coverage);
+  void writeMask(MaskId mask, const SkIRect &rect, const uint8_t *coverage);
+
+  void invalidate(const SkRect &rect);
+  bool isDamaged() { return !this->damaged.empty(); }
+
+  // draws on every tile the bounds cross
+  void draw(const SkRect &bounds,
+            const std::function<void(SkCanvas *)> &drawTile);
+  void repair(const std::function<void(LayerTile &)> &repairTile);
+  void composite(SkCanvas *canvas, const SkRect &region,
+                 const SkPaint *paint);
+};
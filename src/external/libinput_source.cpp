@@ -0,0 +1,132 @@
+// Copyright (c) 2024 DavidDeadly
+#include "libinput_source.h"
+
+#include <cerrno>
+#include <fcntl.h>
+#include <libudev.h>
+#include <poll.h>
+#include <unistd.h>
+
+#include "log.h"
+
+// how often the thread checks if it was stopped while no events arrive
+const int POLL_TIMEOUT_MS = 100;
+
+static const struct libinput_interface interface = {
+    [](const char *path, int flags, void *user_data) {
+      int fd = open(path, flags);
+      return fd < 0 ? -errno : fd;
+    },
+    [](int fd, void *user_data) { close(fd); }};
+
+void LibinputSource::setArea(int width, int height) {
+  this->width = width;
+  this->height = height;
+}
+
+void LibinputSource::stop() { this->running = false; }
+
+InputSample LibinputSource::toSample(struct libinput_event_tablet_tool *event) {
+  struct libinput_tablet_tool *tool =
+      libinput_event_tablet_tool_get_tool(event);
+
+  InputSample sample = {};
+  sample.timestamp = libinput_event_tablet_tool_get_time_usec(event) * 1000;
+  sample.x = libinput_event_tablet_tool_get_x_transformed(event, this->width);
+  sample.y = libinput_event_tablet_tool_get_y_transformed(event, this->height);
+  sample.pressure = 1;
+  sample.isTablet = true;
+
+  if (libinput_tablet_tool_has_pressure(tool))
+    sample.pressure = libinput_event_tablet_tool_get_pressure(event);
+
+  if (libinput_tablet_tool_has_tilt(tool)) {
+    sample.tiltX = libinput_event_tablet_tool_get_tilt_x(event);
+    sample.tiltY = libinput_event_tablet_tool_get_tilt_y(event);
+  }
+
+  bool isEraser =
+      libinput_tablet_tool_get_type(tool) == LIBINPUT_TABLET_TOOL_TYPE_ERASER;
+  sample.tool = isEraser ? TOOL_ERASER : TOOL_PEN;
+  sample.isDown = libinput_event_tablet_tool_get_tip_state(event) ==
+                  LIBINPUT_TABLET_TOOL_TIP_DOWN;
+
+  bool isOut = libinput_event_tablet_tool_get_proximity_state(event) ==
+               LIBINPUT_TABLET_TOOL_PROXIMITY_STATE_OUT;
+  if (isOut) {
+    sample.tool = TOOL_NONE;
+    sample.isDown = false;
+  }
+
+  return sample;
+}
+
+void LibinputSource::run(InputQueue &queue, std::function<void()> notify) {
+  struct udev *udev = udev_new();
+  if (!udev) {
+    LOG_ERROR("libinput", "Failed to initialize udev");
+    return;
+  }
+
+  struct libinput *input = libinput_udev_create_context(&interface, NULL, udev);
+  if (!input) {
+    LOG_ERROR("libinput", "Failed to initialize libinput context");
+    udev_unref(udev);
+    return;
+  }
+
+  if (libinput_udev_assign_seat(input, "seat0") != 0) {
+    LOG_ERROR("libinput", "Failed to assign seat to libinput");
+    libinput_unref(input);
+    udev_unref(udev);
+    return;
+  }
+
+  struct pollfd descriptor = {libinput_get_fd(input), POLLIN, 0};
+
+  while (this->running) {
+    if (poll(&descriptor, 1, POLL_TIMEOUT_MS) <= 0)
+      continue;
+
+    libinput_dispatch(input);
+
+    bool hasSamples = false;
+    struct libinput_event *event;
+
+    for (; (event = libinput_get_event(input)) != NULL;
+         libinput_event_destroy(event)) {
+      auto type = libinput_event_get_type(event);
+
+      if (type == LIBINPUT_EVENT_DEVICE_ADDED) {
+        struct libinput_device *device = libinput_event_get_device(event);
+
+        bool isTablet = libinput_device_has_capability(
+            device, LIBINPUT_DEVICE_CAP_TABLET_TOOL);
+        if (isTablet)
+          LOG_INFO("libinput", "Using tablet: %s",
+                   libinput_device_get_name(device));
+
+        continue;
+      }
+
+      bool isTabletTool = type == LIBINPUT_EVENT_TABLET_TOOL_AXIS ||
+                          type == LIBINPUT_EVENT_TABLET_TOOL_TIP ||
+                          type == LIBINPUT_EVENT_TABLET_TOOL_PROXIMITY;
+      if (!isTabletTool)
+        continue;
+
+      auto *tabletEvent = libinput_event_get_tablet_tool_event(event);
+      // once stopped, the rest are only destroyed
+      if (!pushSample(queue, this->toSample(tabletEvent), this->running))
+        continue;
+
+      hasSamples = true;
+    }
+
+    if (hasSamples)
+      notify();
+  }
+
+  libinput_unref(input);
+  udev_unref(udev);
+}
@@ -0,0 +1,23 @@
+// Copyright (c) 2024 DavidDeadly
+#pragma once
+
+#include <atomic>
+#include <libinput.h>
+
+#include "input.h"
+
+// Tablets and pens found through udev on seat0, sampled at the device rate
+// with absolute positions, pressure and tilt
+class LibinputSource : public IInputSource {
+private:
+  std::atomic<bool> running = true;
+  int width = 0;
+  int height = 0;
+
+  InputSample toSample(struct libinput_event_tablet_tool *event);
+
+public:
+  void setArea(int width, int height);
+  void run(InputQueue &queue, std::function<void()> notify);
+  void stop();
+};
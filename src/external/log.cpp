@@ -0,0 +1,165 @@
+// Copyright (c) 2024 DavidDeadly
+#include "log.h"
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdarg>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <mutex>
+#include <thread>
+
+#include "input.h"
+#include "mpsc_queue.h"
+
+const size_t LOG_QUEUE_SIZE = 1024;
+const size_t LOG_MESSAGE_SIZE = 200;
+const auto LOG_WAKE_INTERVAL = std::chrono::milliseconds(50);
+
+struct LogRecord {
+  uint64_t timestamp;
+  LogLevel level;
+  const char *component; // string literal, so only the pointer is kept
+  char message[LOG_MESSAGE_SIZE];
+};
+
+static const char *LEVEL_NAMES[] = {"DEBUG", "INFO", "WARN", "ERROR"};
+
+static LogLevel levelFromEnvironment() {
+  const char *name = getenv("IPEN_LOG_LEVEL");
+  if (!name)
+    return LOG_LEVEL_INFO;
+
+  if (strcmp(name, "debug") == 0)
+    return LOG_LEVEL_DEBUG;
+  if (strcmp(name, "warning") == 0)
+    return LOG_LEVEL_WARNING;
+  if (strcmp(name, "error") == 0)
+    return LOG_LEVEL_ERROR;
+
+  return LOG_LEVEL_INFO;
+}
+
+static std::atomic<LogLevel> minimumLevel = levelFromEnvironment();
+
+// Owns the queue and the thread writing it out, started on the first
+// message and flushed when the program exits
+class Logger {
+private:
+  MpscQueue<LogRecord, LOG_QUEUE_SIZE> records;
+  std::atomic<uint64_t> dropped = 0;
+  uint64_t start = inputTimestamp();
+
+  std::atomic<bool> running = true;
+  std::atomic<uint64_t> written = 0;
+  std::atomic<uint64_t> pushed = 0;
+  std::mutex wakeLock;
+  std::condition_variable wakeUp;
+  std::thread *writer;
+
+  void write(const LogRecord &record) {
+    double seconds = (record.timestamp - this->start) / 1e9;
+    FILE *stream = record.level >= LOG_LEVEL_WARNING ? stderr : stdout;
+
+    fprintf(stream, "[%10.6f] %-5s %s: %s\n", seconds,
+            LEVEL_NAMES[record.level], record.component, record.message);
+  }
+
+  bool drain() {
+    LogRecord record;
+    bool hasWritten = false;
+
+    while (this->records.pop(record)) {
+      this->write(record);
+      this->written++;
+      hasWritten = true;
+    }
+
+    uint64_t lost = this->dropped.exchange(0);
+    if (lost > 0)
+      fprintf(stderr, "%llu log messages dropped\n", (unsigned long long)lost);
+
+    // flush only once the burst is out, not per message
+    if (hasWritten || lost > 0) {
+      fflush(stdout);
+      fflush(stderr);
+    }
+
+    return hasWritten;
+  }
+
+  void run() {
+    while (this->running) {
+      if (this->drain())
+        continue;
+
+      std::unique_lock<std::mutex> lock(this->wakeLock);
+      this->wakeUp.wait_for(lock, LOG_WAKE_INTERVAL);
+    }
+
+    this->drain();
+  }
+
+public:
+  Logger() {
+    this->writer = new std::thread([this]() { this->run(); });
+  }
+
+  ~Logger() {
+    this->running = false;
+    this->wakeUp.notify_one();
+    this->writer->join();
+    delete this->writer;
+  }
+
+  void log(LogLevel level, const char *component, const char *format,
+           va_list arguments) {
+    uint64_t timestamp = inputTimestamp();
+
+    bool isQueued = this->records.push([&](LogRecord &record) {
+      record.timestamp = timestamp;
+      record.level = level;
+      record.component = component;
+      vsnprintf(record.message, LOG_MESSAGE_SIZE, format, arguments);
+    });
+
+    if (!isQueued) {
+      this->dropped++;
+      return;
+    }
+
+    this->pushed++;
+    this->wakeUp.notify_one();
+  }
+
+  void flush() {
+    this->wakeUp.notify_one();
+
+    uint64_t target = this->pushed;
+    while (this->written < target && this->running)
+      std::this_thread::yield();
+  }
+};
+
+static Logger &logger() {
+  static Logger instance;
+  return instance;
+}
+
+void setLogLevel(LogLevel level) { minimumLevel = level; }
+
+bool isLogEnabled(LogLevel level) {
+  return level >= minimumLevel.load(std::memory_order_relaxed);
+}
+
+void logMessage(LogLevel level, const char *component, const char *format,
+                ...) {
+  va_list arguments;
+  va_start(arguments, format);
+  logger().log(level, component, format, arguments);
+  va_end(arguments);
+}
+
+void flushLog() { logger().flush(); }
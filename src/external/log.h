@@ -0,0 +1,48 @@
+// Copyright (c) 2024 DavidDeadly
+#pragma once
+
+#include <cstdint>
+
+enum LogLevel : uint8_t {
+  LOG_LEVEL_DEBUG,
+  LOG_LEVEL_INFO,
+  LOG_LEVEL_WARNING,
+  LOG_LEVEL_ERROR,
+};
+
+// Messages are formatted by the caller into a ring buffer and written out by
+// a background thread, so logging never waits on the terminal. When the
+// buffer is full messages are dropped, and counted, instead of blocking.
+//
+// The level starts at info, or at the one named by IPEN_LOG_LEVEL (debug,
+// info, warning, error).
+void setLogLevel(LogLevel level);
+bool isLogEnabled(LogLevel level);
+
+void logMessage(LogLevel level, const char *component, const char *format,
+                ...) __attribute__((format(printf, 3, 4)));
+
+// Writes out everything logged so far
+void flushLog();
+
+#define LOG_AT(level, component, ...)                                        \
+  do {                                                                       \
+    if (isLogEnabled(level))                                                 \
+      logMessage(level, component, __VA_ARGS__);                             \
+  } while (0)
+
+// Debug messages sit on per-sample paths, release builds drop them entirely
+#ifdef NDEBUG
+#define LOG_DEBUG(component, ...)                                            \
+  do {                                                                       \
+  } while (0)
+#else
+#define LOG_DEBUG(component, ...)                                            \
+  LOG_AT(LOG_LEVEL_DEBUG, component, __VA_ARGS__)
+#endif
+
+#define LOG_INFO(component, ...) LOG_AT(LOG_LEVEL_INFO, component, __VA_ARGS__)
+#define LOG_WARNING(component, ...)                                          \
+  LOG_AT(LOG_LEVEL_WARNING, component, __VA_ARGS__)
+#define LOG_ERROR(component, ...)                                            \
+  LOG_AT(LOG_LEVEL_ERROR, component, __VA_ARGS__)
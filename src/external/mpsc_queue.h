@@ -0,0 +1,75 @@
+// Copyright (c) 2024 DavidDeadly
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+// Lock-free ring buffer for any number of producer threads and a single
+// consumer. Each slot carries a sequence number telling whose turn it is:
+// producers claim a position with a CAS and publish it through the slot,
+// so a slow producer never leaves a half written item to the consumer.
+template <typename T, size_t Capacity> class MpscQueue {
+  static_assert((Capacity & (Capacity - 1)) == 0,
+                "Capacity must be a power of two");
+
+private:
+  struct Slot {
+    std::atomic<size_t> sequence;
+    T item;
+  };
+
+  Slot slots[Capacity];
+
+  alignas(64) std::atomic<size_t> tail = 0;
+  alignas(64) size_t head = 0; // consumer only
+
+public:
+  MpscQueue() {
+    for (size_t i = 0; i < Capacity; i++)
+      this->slots[i].sequence.store(i, std::memory_order_relaxed);
+  }
+
+  // Claims a slot and fills it in place, false when the queue is full
+  template <typename Fill> bool push(Fill fill) {
+    size_t position = this->tail.load(std::memory_order_relaxed);
+    Slot *slot;
+
+    while (true) {
+      slot = &this->slots[position & (Capacity - 1)];
+      size_t sequence = slot->sequence.load(std::memory_order_acquire);
+      intptr_t turn = (intptr_t)sequence - (intptr_t)position;
+
+      if (turn < 0)
+        return false;
+
+      bool isClaimed =
+          turn == 0 && this->tail.compare_exchange_weak(
+                           position, position + 1, std::memory_order_relaxed);
+      if (isClaimed)
+        break;
+
+      if (turn > 0)
+        position = this->tail.load(std::memory_order_relaxed);
+    }
+
+    fill(slot->item);
+    slot->sequence.store(position + 1, std::memory_order_release);
+
+    return true;
+  }
+
+  bool pop(T &item) {
+    Slot &slot = this->slots[this->head & (Capacity - 1)];
+    size_t sequence = slot.sequence.load(std::memory_order_acquire);
+
+    if (sequence != this->head + 1)
+      return false;
+
+    item = slot.item;
+    slot.sequence.store(this->head + Capacity, std::memory_order_release);
+    this->head++;
+
+    return true;
+  }
+};
@@ -0,0 +1,181 @@
+// Copyright (c) 2024 DavidDeadly
+#include "profiler.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <vector>
+
+#include "imgui.h"
+#include "input.h"
+#include "log.h"
+
+const char *TRACE_PATH = "ipen-trace.json";
+
+static const char *STAGE_NAMES[STAGE_COUNT] = {
+    "input", "gui build", "display", "gui render", "swap",
+};
+
+// The oldest input is kept, what came in while the loop idled is still
+// waiting for a frame
+void FrameProfiler::beginFrame() {
+  this->current = {};
+  this->current.start = inputTimestamp();
+}
+
+void FrameProfiler::beginStage(FrameStage stage) {
+  this->current.stageStart[stage] = inputTimestamp();
+}
+
+void FrameProfiler::endStage(FrameStage stage) {
+  this->current.stageEnd[stage] = inputTimestamp();
+}
+
+void FrameProfiler::addInput(uint64_t timestamp) {
+  if (timestamp == 0)
+    return;
+
+  if (this->oldestInput == 0 || timestamp < this->oldestInput)
+    this->oldestInput = timestamp;
+}
+
+void FrameProfiler::endFrame() {
+  this->current.end = inputTimestamp();
+  this->current.oldestInput = this->oldestInput;
+  this->oldestInput = 0;
+
+  this->frames[this->frameCount % HISTORY] = this->current;
+  this->frameCount++;
+}
+
+int FrameProfiler::recordedFrames() {
+  return std::min<uint64_t>(this->frameCount, HISTORY);
+}
+
+// age 0 is the oldest frame kept
+const FrameTiming &FrameProfiler::frame(int age) {
+  uint64_t first = this->frameCount - this->recordedFrames();
+  return this->frames[(first + age) % HISTORY];
+}
+
+static float milliseconds(uint64_t start, uint64_t end) {
+  return end > start ? (end - start) / 1e6f : 0;
+}
+
+// Plots one measure over the kept frames with its percentiles on top
+static void plotMeasure(const char *name, std::vector<float> &values) {
+  if (values.empty())
+    return;
+
+  std::vector<float> sorted = values;
+  std::sort(sorted.begin(), sorted.end());
+
+  auto percentile = [&sorted](double fraction) {
+    return sorted[std::min<size_t>(fraction * sorted.size(),
+                                   sorted.size() - 1)];
+  };
+
+  char overlay[96];
+  snprintf(overlay, sizeof(overlay), "p50 %.2f  p95 %.2f  p99 %.2f ms",
+           percentile(0.5), percentile(0.95), percentile(0.99));
+
+  ImGui::PlotLines(name, values.data(), values.size(), 0, overlay, 0,
+                   std::max(percentile(0.99) * 1.2f, 1.0f), ImVec2(0, 48));
+}
+
+void FrameProfiler::drawPanel(bool *isOpen) {
+  if (!ImGui::Begin("Profiler", isOpen)) {
+    ImGui::End();
+    return;
+  }
+
+  int count = this->recordedFrames();
+  ImGui::Text("Last %d frames, F3 to hide", count);
+
+  std::vector<float> values;
+  values.reserve(count);
+
+  for (int age = 0; age < count; age++) {
+    const FrameTiming &timing = this->frame(age);
+    values.push_back(milliseconds(timing.start, timing.end));
+  }
+  plotMeasure("frame", values);
+
+  for (int stage = 0; stage < STAGE_COUNT; stage++) {
+    values.clear();
+    for (int age = 0; age < count; age++) {
+      const FrameTiming &timing = this->frame(age);
+      values.push_back(
+          milliseconds(timing.stageStart[stage], timing.stageEnd[stage]));
+    }
+    plotMeasure(STAGE_NAMES[stage], values);
+  }
+
+  // the swap returning is the closest the loop gets to the photons
+  values.clear();
+  for (int age = 0; age < count; age++) {
+    const FrameTiming &timing = this->frame(age);
+    if (timing.oldestInput != 0)
+      values.push_back(milliseconds(timing.oldestInput, timing.end));
+  }
+  plotMeasure("input to swap", values);
+
+  if (ImGui::Button("Export trace")) {
+    bool isExported = this->exportTrace(TRACE_PATH);
+    if (isExported)
+      LOG_INFO("profiler", "Frame trace written to %s", TRACE_PATH);
+  }
+
+  ImGui::End();
+}
+
+// Writes the kept frames in the Chrome trace event format, for
+// chrome://tracing or Perfetto: each frame with its stages nested in it
+// and the input latency as a counter
+bool FrameProfiler::exportTrace(const char *path) {
+  FILE *trace = fopen(path, "w");
+  if (!trace) {
+    LOG_ERROR("profiler", "Failed to create trace: %s", path);
+    return false;
+  }
+
+  int count = this->recordedFrames();
+  uint64_t origin = count > 0 ? this->frame(0).start : 0;
+  auto micros = [origin](uint64_t timestamp) {
+    return (timestamp - origin) / 1e3;
+  };
+
+  fprintf(trace, "{\"traceEvents\":[\n");
+  bool isFirst = true;
+
+  auto event = [&](const char *name, uint64_t start, uint64_t end) {
+    fprintf(trace,
+            "%s{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":1,"
+            "\"ts\":%.3f,\"dur\":%.3f}",
+            isFirst ? "" : ",\n", name, micros(start),
+            (end - start) / 1e3);
+    isFirst = false;
+  };
+
+  for (int age = 0; age < count; age++) {
+    const FrameTiming &timing = this->frame(age);
+    event("frame", timing.start, timing.end);
+
+    for (int stage = 0; stage < STAGE_COUNT; stage++)
+      if (timing.stageEnd[stage] > timing.stageStart[stage])
+        event(STAGE_NAMES[stage], timing.stageStart[stage],
+              timing.stageEnd[stage]);
+
+    if (timing.oldestInput != 0) {
+      fprintf(trace,
+              ",\n{\"name\":\"input to swap\",\"ph\":\"C\",\"pid\":1,"
+              "\"ts\":%.3f,\"args\":{\"ms\":%.3f}}",
+              micros(timing.end),
+              milliseconds(timing.oldestInput, timing.end));
+    }
+  }
+
+  fprintf(trace, "\n]}\n");
+  fclose(trace);
+
+  return true;
+}
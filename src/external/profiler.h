@@ -0,0 +1,50 @@
+// Copyright (c) 2024 DavidDeadly
+#pragma once
+
+#include <array>
+#include <cstdint>
+
+enum FrameStage {
+  STAGE_INPUT,
+  STAGE_GUI_BUILD,
+  STAGE_DISPLAY,
+  STAGE_GUI_RENDER,
+  STAGE_SWAP,
+  STAGE_COUNT,
+};
+
+struct FrameTiming {
+  uint64_t start;
+  uint64_t end;
+  std::array<uint64_t, STAGE_COUNT> stageStart;
+  std::array<uint64_t, STAGE_COUNT> stageEnd;
+  uint64_t oldestInput; // 0 when the frame showed no new input
+};
+
+// Keeps the timings of the last frames of the render loop, stage by stage,
+// along with how long the oldest input sample of each frame waited for the
+// swap showing it. Recording is a few clock reads per frame, so it is
+// always on and the panel or a trace can be looked at after the fact.
+class FrameProfiler {
+private:
+  static const int HISTORY = 1800; // 30s at 60Hz
+
+  std::array<FrameTiming, HISTORY> frames;
+  uint64_t frameCount = 0;
+
+  FrameTiming current = {};
+  uint64_t oldestInput = 0;
+
+  const FrameTiming &frame(int age);
+  int recordedFrames();
+
+public:
+  void beginFrame();
+  void beginStage(FrameStage stage);
+  void endStage(FrameStage stage);
+  void addInput(uint64_t timestamp);
+  void endFrame();
+
+  void drawPanel(bool *isOpen);
+  bool exportTrace(const char *path);
+};
@@ -0,0 +1,111 @@
+// Copyright (c) 2024 DavidDeadly
+#include "script_source.h"
+
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <thread>
+
+const auto FRAME_INTERVAL = std::chrono::microseconds(16667);
+
+ScriptSource::ScriptSource(const char *scriptPath, bool isRealtime) {
+  this->isRealtime = isRealtime;
+
+  std::ifstream script(scriptPath);
+  if (!script) {
+    std::cerr << "Failed to open input script: " << scriptPath << std::endl;
+    return;
+  }
+
+  std::vector<InputSample> frame;
+  std::string line;
+  int lineNumber = 0;
+
+  while (std::getline(script, line)) {
+    lineNumber++;
+
+    std::istringstream words(line);
+    std::string command;
+    if (!(words >> command) || command[0] == '#')
+      continue;
+
+    if (command == "area") {
+      words >> this->scriptWidth >> this->scriptHeight;
+      continue;
+    }
+
+    if (command == "frame") {
+      this->frames.push_back(frame);
+      frame.clear();
+      continue;
+    }
+
+    InputSample sample = {};
+    sample.pressure = 1;
+    words >> sample.x >> sample.y;
+
+    if (command == "pen") {
+      sample.tool = TOOL_PEN;
+      sample.isDown = true;
+      words >> sample.pressure;
+    } else if (command == "eraser") {
+      sample.tool = TOOL_ERASER;
+      sample.isDown = true;
+    } else if (command == "up") {
+      sample.tool = TOOL_PEN;
+    } else {
+      std::cerr << scriptPath << ":" << lineNumber
+                << ": unknown command: " << command << std::endl;
+      continue;
+    }
+
+    frame.push_back(sample);
+
+    // a frame always fits the queue, the reader may be on this same thread
+    if (frame.size() == INPUT_QUEUE_SIZE) {
+      this->frames.push_back(frame);
+      frame.clear();
+    }
+  }
+
+  if (!frame.empty())
+    this->frames.push_back(frame);
+}
+
+void ScriptSource::setArea(int width, int height) {
+  if (this->scriptWidth <= 0 || this->scriptHeight <= 0)
+    return;
+
+  this->scaleX = (float)width / this->scriptWidth;
+  this->scaleY = (float)height / this->scriptHeight;
+}
+
+bool ScriptSource::nextFrame(InputQueue &queue) {
+  if (this->nextFrameIndex >= this->frames.size())
+    return false;
+
+  for (InputSample sample : this->frames[this->nextFrameIndex]) {
+    sample.timestamp = inputTimestamp();
+    sample.x *= this->scaleX;
+    sample.y *= this->scaleY;
+
+    if (!pushSample(queue, sample, this->running))
+      return false;
+  }
+
+  this->nextFrameIndex++;
+  return true;
+}
+
+void ScriptSource::stop() { this->running = false; }
+
+void ScriptSource::run(InputQueue &queue, std::function<void()> notify) {
+  while (this->running && this->nextFrame(queue)) {
+    notify();
+
+    if (this->isRealtime)
+      std::this_thread::sleep_for(FRAME_INTERVAL);
+  }
+}
@@ -0,0 +1,39 @@
+// Copyright (c) 2024 DavidDeadly
+#pragma once
+
+#include <atomic>
+#include <vector>
+
+#include "input.h"
+
+// Plays pointer input written as a text script, one command per line:
+//
+//   area <width> <height>     size the coordinates below are relative to
+//   pen <x> <y> [pressure]    pen down at a point
+//   eraser <x> <y>            eraser down at a point
+//   up <x> <y>                lifts whatever tool is down
+//   frame                     ends the samples of a frame
+//
+// Empty lines and lines starting with # are skipped.
+class ScriptSource : public IInputSource {
+private:
+  std::atomic<bool> running = true;
+  std::vector<std::vector<InputSample>> frames;
+  size_t nextFrameIndex = 0;
+
+  int scriptWidth = 0;
+  int scriptHeight = 0;
+  float scaleX = 1;
+  float scaleY = 1;
+  bool isRealtime;
+
+public:
+  ScriptSource(const char *scriptPath, bool isRealtime);
+
+  // Queues the samples of the next frame, false once the script is over
+  bool nextFrame(InputQueue &queue);
+
+  void setArea(int width, int height);
+  void run(InputQueue &queue, std::function<void()> notify);
+  void stop();
+};
@@ -0,0 +1,100 @@
+// Copyright (c) 2024 DavidDeadly
+#include "session_recording.h"
+
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+
+#include "input.h"
+
+struct __attribute__((packed)) PackedSessionEvent {
+  uint32_t delta; // microseconds since the previous event
+  uint8_t type;
+  float x;
+  float y;
+  int16_t code;
+  uint8_t action;
+  uint8_t mods;
+};
+
+SessionRecorder::SessionRecorder(const char *path) {
+  this->file = fopen(path, "wb");
+  if (!this->file) {
+    std::cerr << "Failed to create session recording: " << path << std::endl;
+    return;
+  }
+
+  fwrite(SESSION_MAGIC, sizeof(SESSION_MAGIC), 1, this->file);
+  this->start = inputTimestamp();
+  this->lastEvent = this->start;
+}
+
+SessionRecorder::~SessionRecorder() {
+  if (this->file)
+    fclose(this->file);
+}
+
+void SessionRecorder::record(SessionEventType type, float x, float y,
+                             int code, int action, int mods) {
+  if (!this->file)
+    return;
+
+  // deltas are kept relative to the rounded clock so errors don't add up
+  uint64_t now = inputTimestamp();
+  uint64_t delta = (now - this->lastEvent) / 1000;
+  this->lastEvent += delta * 1000;
+
+  PackedSessionEvent packed;
+  packed.delta = std::min<uint64_t>(delta, UINT32_MAX);
+  packed.type = type;
+  packed.x = x;
+  packed.y = y;
+  packed.code = code;
+  packed.action = action;
+  packed.mods = mods;
+
+  fwrite(&packed, sizeof(packed), 1, this->file);
+}
+
+SessionReader::SessionReader(const char *path) {
+  FILE *file = fopen(path, "rb");
+  if (!file) {
+    std::cerr << "Failed to open session recording: " << path << std::endl;
+    return;
+  }
+
+  char magic[sizeof(SESSION_MAGIC)];
+  bool hasHeader = fread(magic, sizeof(magic), 1, file) == 1 &&
+                   memcmp(magic, SESSION_MAGIC, sizeof(magic)) == 0;
+
+  if (!hasHeader) {
+    std::cerr << "Invalid session recording: " << path << std::endl;
+    fclose(file);
+    return;
+  }
+
+  this->file = file;
+}
+
+SessionReader::~SessionReader() {
+  if (this->file)
+    fclose(this->file);
+}
+
+bool SessionReader::next(SessionEvent &event) {
+  PackedSessionEvent packed;
+  if (!this->file || fread(&packed, sizeof(packed), 1, this->file) != 1)
+    return false;
+
+  this->clock += packed.delta * 1000ull;
+
+  event.timestamp = this->clock;
+  event.type = (SessionEventType)packed.type;
+  event.x = packed.x;
+  event.y = packed.y;
+  event.code = packed.code;
+  event.action = packed.action;
+  event.mods = packed.mods;
+
+  return true;
+}
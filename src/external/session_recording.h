@@ -0,0 +1,61 @@
+// Copyright (c) 2024 DavidDeadly
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+
+enum SessionEventType : uint8_t {
+  SESSION_CURSOR,
+  SESSION_BUTTON,
+  SESSION_KEY,
+  // what the toolbar did, its own input isn't replayed
+  SESSION_COLOR,  // code is the channel, x its value
+  SESSION_ERASER, // code is the mode
+  SESSION_RESET,
+};
+
+// Set in mods of the pointer events the toolbar had, they only change the
+// state of the buttons when replayed
+const uint8_t SESSION_FOR_GUI = 0x80;
+
+// A window event as the canvas received it
+struct SessionEvent {
+  uint64_t timestamp; // nanoseconds since the recording started
+  SessionEventType type;
+  float x; // cursor position, for every type
+  float y;
+  int16_t code; // button or key
+  uint8_t action;
+  uint8_t mods;
+};
+
+// Recordings are this magic followed by packed events, each one stamped
+// with the microseconds since the previous one
+const char SESSION_MAGIC[8] = {'I', 'P', 'E', 'N', 'S', 'E', 'S', '1'};
+
+class SessionRecorder {
+private:
+  FILE *file = NULL;
+  uint64_t start = 0;
+  uint64_t lastEvent = 0;
+
+public:
+  SessionRecorder(const char *path);
+  ~SessionRecorder();
+
+  void record(SessionEventType type, float x, float y, int code, int action,
+              int mods);
+};
+
+class SessionReader {
+private:
+  FILE *file = NULL;
+  uint64_t clock = 0;
+
+public:
+  SessionReader(const char *path);
+  ~SessionReader();
+
+  bool isOpen() { return this->file != NULL; }
+  bool next(SessionEvent &event);
+};
@@ -0,0 +1,76 @@
+// Copyright (c) 2024 DavidDeadly
+#include "simplify.h"
+
+#include <algorithm>
+#include <utility>
+#include <vector>
+
+// How far a point is from the segment between two others, along the
+// centerline or in half width, whichever is larger
+static float deviation(const SkPoint &start, float startWidth,
+                       const SkPoint &end, float endWidth,
+                       const SkPoint &point, float width) {
+  SkVector direction = end - start;
+  float lengthSquared = direction.dot(direction);
+
+  float scaleFactor = 0;
+  if (lengthSquared > 0)
+    scaleFactor = (point - start).dot(direction) / lengthSquared;
+  scaleFactor = std::clamp(scaleFactor, 0.0f, 1.0f);
+
+  SkPoint closest = start + direction * scaleFactor;
+  float widthAt = startWidth + (endWidth - startWidth) * scaleFactor;
+
+  return std::max(SkPoint::Distance(closest, point),
+                  std::abs(width - widthAt) / 2);
+}
+
+uint32_t simplifyStroke(SkPoint *points, float *widths, uint32_t length,
+                        float tolerance) {
+  if (length < 3)
+    return length;
+
+  std::vector<bool> isKept(length, false);
+  isKept[0] = true;
+  isKept[length - 1] = true;
+
+  // ranges still to split, kept on a stack instead of recursing so long
+  // strokes can't run out of it
+  std::vector<std::pair<uint32_t, uint32_t>> ranges = {{0, length - 1}};
+
+  while (!ranges.empty()) {
+    auto [first, last] = ranges.back();
+    ranges.pop_back();
+
+    float farthest = 0;
+    uint32_t split = first;
+
+    for (uint32_t i = first + 1; i < last; i++) {
+      float distance = deviation(points[first], widths[first], points[last],
+                                 widths[last], points[i], widths[i]);
+      if (distance > farthest) {
+        farthest = distance;
+        split = i;
+      }
+    }
+
+    if (farthest <= tolerance)
+      continue;
+
+    isKept[split] = true;
+    ranges.push_back({first, split});
+    ranges.push_back({split, last});
+  }
+
+  uint32_t kept = 0;
+  for (uint32_t i = 0; i < length; i++) {
+    if (!isKept[i])
+      continue;
+
+    points[kept] = points[i];
+    widths[kept] = widths[i];
+    kept++;
+  }
+
+  return kept;
+}
@@ -0,0 +1,13 @@
+// Copyright (c) 2024 DavidDeadly
+#pragma once
+
+#include <cstdint>
+
+#include "include/core/SkPoint.h"
+
+// Ramer-Douglas-Peucker over the points of a stroke and their widths: keeps
+// only the points that can't be left out without the centerline or the
+// width moving by more than the tolerance. Works in place, the ends are
+// always kept, and returns how many points are left.
+uint32_t simplifyStroke(SkPoint *points, float *widths, uint32_t length,
+                        float tolerance);
@@ -0,0 +1,52 @@
+// Copyright (c) 2024 DavidDeadly
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+
+// Lock-free ring buffer between exactly one producer thread and one consumer
+// thread. Indexes only grow, so full and empty never look the same.
+template <typename T, size_t Capacity> class SpscQueue {
+  static_assert((Capacity & (Capacity - 1)) == 0,
+                "Capacity must be a power of two");
+
+private:
+  T items[Capacity];
+
+  // each index is written by one side only, keep them on their own lines
+  alignas(64) std::atomic<size_t> head = 0;
+  alignas(64) std::atomic<size_t> tail = 0;
+
+public:
+  bool push(const T &item) {
+    size_t tail = this->tail.load(std::memory_order_relaxed);
+    size_t head = this->head.load(std::memory_order_acquire);
+
+    if (tail - head == Capacity)
+      return false;
+
+    this->items[tail & (Capacity - 1)] = item;
+    this->tail.store(tail + 1, std::memory_order_release);
+
+    return true;
+  }
+
+  size_t popBatch(T *batch, size_t maxItems) {
+    size_t head = this->head.load(std::memory_order_relaxed);
+    size_t tail = this->tail.load(std::memory_order_acquire);
+    size_t count = std::min(tail - head, maxItems);
+
+    for (size_t i = 0; i < count; i++)
+      batch[i] = this->items[(head + i) & (Capacity - 1)];
+
+    this->head.store(head + count, std::memory_order_release);
+
+    return count;
+  }
+
+  bool isEmpty() {
+    return this->head.load(std::memory_order_acquire) ==
+           this->tail.load(std::memory_order_acquire);
+  }
+};
@@ -0,0 +1,456 @@
+// Copyright (c) 2024 DavidDeadly
+#include "stroke_file.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <string>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#ifdef IPEN_ZSTD
+#include <zstd.h>
+#endif
+
+#include "log.h"
+
+const float POINT_SCALE = 16;
+const float WIDTH_SCALE = 64;
+const int ZSTD_LEVEL = 3;
+// version 1 headers end before the journal sequence
+const size_t V1_HEADER_SIZE = offsetof(StrokeFileHeader, reserved);
+
+void MaskPixels::clear() {
+  this->position = 0;
+  this->tiles.clear();
+  this->coverage.clear();
+}
+
+void StrokeBatch::clear() {
+  this->colors.clear();
+  this->lengths.clear();
+  this->points.clear();
+  this->widths.clear();
+  this->isMask = false;
+  this->mask.clear();
+}
+
+static void writeVarint(std::vector<uint8_t> &out, uint32_t value) {
+  while (value >= 0x80) {
+    out.push_back((value & 0x7F) | 0x80);
+    value >>= 7;
+  }
+
+  out.push_back(value);
+}
+
+static bool readVarint(const uint8_t *&cursor, const uint8_t *end,
+                       uint32_t &value) {
+  value = 0;
+
+  for (int shift = 0; shift < 35; shift += 7) {
+    if (cursor == end)
+      return false;
+
+    uint8_t byte = *cursor++;
+    value |= (uint32_t)(byte & 0x7F) << shift;
+    if (!(byte & 0x80))
+      return true;
+  }
+
+  return false;
+}
+
+static uint32_t zigzag(int32_t value) {
+  return ((uint32_t)value << 1) ^ (uint32_t)(value >> 31);
+}
+
+static int32_t unzigzag(uint32_t value) {
+  return (int32_t)(value >> 1) ^ -(int32_t)(value & 1);
+}
+
+// A stroke's style index and length, then each point as its difference with
+// the previous one, the first with the origin
+static void encodeStroke(std::vector<uint8_t> &out, uint32_t style,
+                         const SkPoint *points, const float *widths,
+                         uint32_t length) {
+  writeVarint(out, style);
+  writeVarint(out, length);
+
+  int32_t lastX = 0, lastY = 0, lastWidth = 0;
+  for (uint32_t i = 0; i < length; i++) {
+    int32_t x = std::lround(points[i].fX * POINT_SCALE);
+    int32_t y = std::lround(points[i].fY * POINT_SCALE);
+    int32_t width = std::lround(widths[i] * WIDTH_SCALE);
+
+    writeVarint(out, zigzag(x - lastX));
+    writeVarint(out, zigzag(y - lastY));
+    writeVarint(out, zigzag(width - lastWidth));
+
+    lastX = x;
+    lastY = y;
+    lastWidth = width;
+  }
+}
+
+// The tiles' bounds, then all their pixels
+static void encodeMask(std::vector<uint8_t> &out, const MaskPixels &mask) {
+  writeVarint(out, mask.tiles.size());
+  for (const auto &tile : mask.tiles) {
+    writeVarint(out, tile.left());
+    writeVarint(out, tile.top());
+    writeVarint(out, tile.width());
+    writeVarint(out, tile.height());
+  }
+
+  out.insert(out.end(), mask.coverage.begin(), mask.coverage.end());
+}
+
+static void appendBytes(std::vector<uint8_t> &out, const void *data,
+                        size_t size) {
+  const uint8_t *bytes = (const uint8_t *)data;
+  out.insert(out.end(), bytes, bytes + size);
+}
+
+static void appendRawBlock(std::vector<uint8_t> &out, uint32_t strokeCount,
+                           const std::vector<uint8_t> &raw) {
+  StrokeBlockHeader block = {strokeCount, (uint32_t)raw.size(),
+                             (uint32_t)raw.size(), BLOCK_RAW};
+
+  appendBytes(out, &block, sizeof(block));
+  appendBytes(out, raw.data(), raw.size());
+}
+
+#ifdef IPEN_ZSTD
+// Compressed when it gets smaller, as it is otherwise
+static void appendBlock(std::vector<uint8_t> &out, uint32_t strokeCount,
+                        const uint8_t *raw, size_t size,
+                        std::vector<uint8_t> &compressed) {
+  StrokeBlockHeader block = {strokeCount, (uint32_t)size, (uint32_t)size,
+                             BLOCK_RAW};
+  const uint8_t *payload = raw;
+
+  compressed.resize(ZSTD_compressBound(size));
+  size_t compressedSize = ZSTD_compress(compressed.data(), compressed.size(),
+                                        raw, size, ZSTD_LEVEL);
+
+  bool isSmaller = !ZSTD_isError(compressedSize) && compressedSize < size;
+  if (isSmaller) {
+    block.storedSize = compressedSize;
+    block.codec = BLOCK_ZSTD;
+    payload = compressed.data();
+  }
+
+  appendBytes(out, &block, sizeof(block));
+  appendBytes(out, payload, block.storedSize);
+}
+#endif
+
+// The whole file in memory, so it can be written out by another thread.
+// A block of strokes ends early where a mask goes.
+std::vector<uint8_t> encodeStrokes(StrokeStore &store,
+                                   const std::vector<StrokeId> &strokes,
+                                   const std::vector<MaskPixels> &masks,
+                                   uint64_t journalSequence) {
+  std::vector<SkColor> styles;
+  std::vector<uint32_t> strokeStyles;
+
+  for (const auto stroke : strokes) {
+    SkColor color = store.paint(stroke).getColor();
+    auto style = std::find(styles.begin(), styles.end(), color);
+    strokeStyles.push_back(style - styles.begin());
+
+    if (style == styles.end())
+      styles.push_back(color);
+  }
+
+  StrokeFileHeader header = {};
+  memcpy(header.magic, STROKE_FILE_MAGIC, sizeof(header.magic));
+  header.version = STROKE_FILE_VERSION;
+  header.styleCount = styles.size();
+  header.strokeCount = strokes.size();
+  header.journalSequence = journalSequence;
+
+  std::vector<uint8_t> bytes;
+  appendBytes(bytes, &header, sizeof(header));
+  appendBytes(bytes, styles.data(), styles.size() * sizeof(SkColor));
+
+  std::vector<uint8_t> raw;
+  size_t nextMask = 0;
+  size_t first = 0;
+  while (first < strokes.size() || nextMask < masks.size()) {
+    bool isMaskNext = nextMask < masks.size() &&
+                      masks[nextMask].position <= first;
+    if (isMaskNext) {
+      raw.clear();
+      encodeMask(raw, masks[nextMask++]);
+      appendRawBlock(bytes, MASK_BLOCK, raw);
+      header.blockCount++;
+      continue;
+    }
+
+    size_t last = std::min<size_t>(first + STROKES_PER_BLOCK, strokes.size());
+    if (nextMask < masks.size())
+      last = std::min<size_t>(last, masks[nextMask].position);
+    raw.clear();
+
+    for (size_t i = first; i < last; i++) {
+      StrokeId stroke = strokes[i];
+      encodeStroke(raw, strokeStyles[i], store.pointsOf(stroke),
+                   store.widthsOf(stroke), store.length(stroke));
+    }
+
+    appendRawBlock(bytes, last - first, raw);
+    header.blockCount++;
+    first = last;
+  }
+
+  // only known once the strokes are split around the masks
+  memcpy(bytes.data(), &header, sizeof(header));
+  return bytes;
+}
+
+std::vector<uint8_t> compressBlocks(std::vector<uint8_t> &&raw) {
+#ifdef IPEN_ZSTD
+  StrokeFileHeader header;
+  memcpy(&header, raw.data(), sizeof(header));
+  size_t cursor =
+      sizeof(header) + (size_t)header.styleCount * sizeof(SkColor);
+
+  std::vector<uint8_t> bytes(raw.begin(), raw.begin() + cursor);
+  std::vector<uint8_t> compressed;
+  for (uint32_t i = 0; i < header.blockCount; i++) {
+    StrokeBlockHeader block;
+    memcpy(&block, raw.data() + cursor, sizeof(block));
+    cursor += sizeof(block);
+
+    appendBlock(bytes, block.strokeCount, raw.data() + cursor,
+                block.storedSize, compressed);
+    cursor += block.storedSize;
+  }
+
+  return bytes;
+#else
+  return std::move(raw);
+#endif
+}
+
+// Written next to the destination first and renamed over it once synced,
+// so a failed save leaves the previous drawing in place
+bool writeStrokeFile(const char *path, const std::vector<uint8_t> &bytes) {
+  std::string temporaryPath = std::string(path) + ".tmp";
+  FILE *file = fopen(temporaryPath.c_str(), "wb");
+  if (!file) {
+    LOG_ERROR("strokes", "Failed to create drawing: %s", path);
+    return false;
+  }
+
+  bool isWritten = fwrite(bytes.data(), 1, bytes.size(), file) ==
+                       bytes.size() &&
+                   fflush(file) == 0 && fsync(fileno(file)) == 0;
+  fclose(file);
+
+  if (!isWritten || rename(temporaryPath.c_str(), path) != 0) {
+    LOG_ERROR("strokes", "Failed to save drawing: %s", path);
+    remove(temporaryPath.c_str());
+    return false;
+  }
+
+  return true;
+}
+
+bool saveStrokes(const char *path, StrokeStore &store,
+                 const std::vector<StrokeId> &strokes,
+                 const std::vector<MaskPixels> &masks) {
+  bool isSaved = writeStrokeFile(
+      path, compressBlocks(encodeStrokes(store, strokes, masks, 0)));
+  if (isSaved)
+    LOG_INFO("strokes", "Saved %zu strokes to %s", strokes.size(), path);
+
+  return isSaved;
+}
+
+StrokeFileReader::StrokeFileReader(const char *path) {
+  int file = open(path, O_RDONLY);
+  if (file < 0) {
+    if (errno == ENOENT)
+      LOG_INFO("strokes", "Starting a new drawing: %s", path);
+    else
+      LOG_ERROR("strokes", "Failed to open drawing: %s", path);
+    return;
+  }
+
+  struct stat info;
+  bool hasHeader = fstat(file, &info) == 0 &&
+                   (size_t)info.st_size >= V1_HEADER_SIZE;
+  if (!hasHeader) {
+    LOG_ERROR("strokes", "Invalid drawing: %s", path);
+    close(file);
+    return;
+  }
+
+  void *mapping =
+      mmap(nullptr, info.st_size, PROT_READ, MAP_PRIVATE, file, 0);
+  close(file);
+
+  if (mapping == MAP_FAILED) {
+    LOG_ERROR("strokes", "Failed to map drawing: %s", path);
+    return;
+  }
+
+  madvise(mapping, info.st_size, MADV_SEQUENTIAL);
+  this->data = (const uint8_t *)mapping;
+  this->size = info.st_size;
+
+  memcpy(&this->header, this->data, V1_HEADER_SIZE);
+  size_t headerSize = V1_HEADER_SIZE;
+
+  bool hasSequence = this->header.version >= 2 &&
+                     this->size >= sizeof(this->header);
+  if (hasSequence) {
+    memcpy(&this->header, this->data, sizeof(this->header));
+    headerSize = sizeof(this->header);
+  }
+
+  size_t stylesEnd =
+      headerSize + (size_t)this->header.styleCount * sizeof(SkColor);
+
+  bool hasMagic = memcmp(this->header.magic, STROKE_FILE_MAGIC,
+                         sizeof(STROKE_FILE_MAGIC)) == 0;
+  bool isValid = hasMagic && this->header.version <= STROKE_FILE_VERSION &&
+                 stylesEnd <= this->size;
+  if (!isValid) {
+    LOG_ERROR("strokes", "Invalid drawing: %s", path);
+    munmap(mapping, this->size);
+    this->data = nullptr;
+    return;
+  }
+
+  this->styles = (const SkColor *)(this->data + headerSize);
+  this->cursor = stylesEnd;
+}
+
+StrokeFileReader::~StrokeFileReader() {
+  if (this->data)
+    munmap((void *)this->data, this->size);
+}
+
+static bool decodeStrokes(const uint8_t *cursor, const uint8_t *end,
+                          uint32_t strokeCount, const SkColor *styles,
+                          uint32_t styleCount, StrokeBatch &batch) {
+  for (uint32_t stroke = 0; stroke < strokeCount; stroke++) {
+    uint32_t style, length;
+    bool hasStroke = readVarint(cursor, end, style) &&
+                     readVarint(cursor, end, length) && style < styleCount;
+    if (!hasStroke)
+      return false;
+
+    batch.colors.push_back(styles[style]);
+    batch.lengths.push_back(length);
+
+    int32_t x = 0, y = 0, width = 0;
+    for (uint32_t i = 0; i < length; i++) {
+      uint32_t dx, dy, dw;
+      bool hasPoint = readVarint(cursor, end, dx) &&
+                      readVarint(cursor, end, dy) &&
+                      readVarint(cursor, end, dw);
+      if (!hasPoint)
+        return false;
+
+      x += unzigzag(dx);
+      y += unzigzag(dy);
+      width += unzigzag(dw);
+
+      batch.points.push_back(SkPoint::Make(x / POINT_SCALE, y / POINT_SCALE));
+      batch.widths.push_back(width / WIDTH_SCALE);
+    }
+  }
+
+  return true;
+}
+
+static bool decodeMask(const uint8_t *cursor, const uint8_t *end,
+                       MaskPixels &mask) {
+  uint32_t tileCount;
+  if (!readVarint(cursor, end, tileCount))
+    return false;
+
+  size_t pixels = 0;
+  for (uint32_t i = 0; i < tileCount; i++) {
+    uint32_t left, top, width, height;
+    bool hasTile = readVarint(cursor, end, left) &&
+                   readVarint(cursor, end, top) &&
+                   readVarint(cursor, end, width) &&
+                   readVarint(cursor, end, height);
+    if (!hasTile)
+      return false;
+
+    mask.tiles.push_back(SkIRect::MakeXYWH(left, top, width, height));
+    pixels += (size_t)width * height;
+  }
+
+  if ((size_t)(end - cursor) != pixels)
+    return false;
+
+  mask.coverage.assign(cursor, end);
+  return true;
+}
+
+bool StrokeFileReader::next(StrokeBatch &batch) {
+  batch.clear();
+
+  bool hasBlock = this->data && this->blocksRead < this->header.blockCount &&
+                  this->cursor + sizeof(StrokeBlockHeader) <= this->size;
+  if (!hasBlock)
+    return false;
+
+  StrokeBlockHeader block;
+  memcpy(&block, this->data + this->cursor, sizeof(block));
+  this->cursor += sizeof(block);
+
+  if (this->cursor + block.storedSize > this->size) {
+    LOG_ERROR("strokes", "Drawing ends in the middle of a block");
+    return false;
+  }
+
+  const uint8_t *payload = this->data + this->cursor;
+  this->cursor += block.storedSize;
+  this->blocksRead++;
+
+  if (block.codec == BLOCK_ZSTD) {
+#ifdef IPEN_ZSTD
+    this->scratch.resize(block.rawSize);
+    size_t rawSize = ZSTD_decompress(this->scratch.data(), block.rawSize,
+                                     payload, block.storedSize);
+    if (ZSTD_isError(rawSize) || rawSize != block.rawSize) {
+      LOG_ERROR("strokes", "Failed to decompress a block of the drawing");
+      return false;
+    }
+
+    payload = this->scratch.data();
+#else
+    LOG_ERROR("strokes", "Drawing is compressed, ipen was built without zstd");
+    return false;
+#endif
+  } else if (block.codec != BLOCK_RAW || block.rawSize > block.storedSize) {
+    LOG_ERROR("strokes", "Invalid block in the drawing");
+    return false;
+  }
+
+  batch.isMask =
+      this->header.version >= 3 && block.strokeCount == MASK_BLOCK;
+  bool isDecoded =
+      batch.isMask
+          ? decodeMask(payload, payload + block.rawSize, batch.mask)
+          : decodeStrokes(payload, payload + block.rawSize, block.strokeCount,
+                          this->styles, this->header.styleCount, batch);
+  if (!isDecoded) {
+    LOG_ERROR("strokes", "Corrupted block in the drawing");
+    batch.clear();
+  }
+
+  return isDecoded;
+}
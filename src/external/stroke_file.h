@@ -0,0 +1,106 @@
+// Copyright (c) 2024 DavidDeadly
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "include/core/SkColor.h"
+#include "include/core/SkPoint.h"
+#include "include/core/SkRect.h"
+
+#include "strokes.h"
+
+// Drawings are saved as a header, the table of stroke colors, then the
+// strokes in blocks, each one compressed on its own when zstd is available
+// so a drawing can be loaded a block at a time. Points are stored as
+// varints of their zigzagged difference with the previous point, in
+// sixteenths of a pixel. Version 2 added the journal sequence, version 3
+// the pixel eraser's masks, each a block of its own between the strokes it
+// goes over and the ones after it.
+const char STROKE_FILE_MAGIC[8] = {'I', 'P', 'E', 'N', 'S', 'T', 'R', 'K'};
+const uint16_t STROKE_FILE_VERSION = 3;
+const uint32_t STROKES_PER_BLOCK = 1024;
+const uint32_t MASK_BLOCK = UINT32_MAX; // in place of the stroke count
+
+struct StrokeFileHeader {
+  char magic[8];
+  uint16_t version;
+  uint16_t flags;
+  uint32_t styleCount;
+  uint32_t strokeCount;
+  uint32_t blockCount;
+  uint32_t reserved;
+  uint64_t journalSequence; // last journal record the drawing includes
+};
+
+enum StrokeBlockCodec : uint32_t {
+  BLOCK_RAW,
+  BLOCK_ZSTD,
+};
+
+struct StrokeBlockHeader {
+  uint32_t strokeCount;
+  uint32_t rawSize;
+  uint32_t storedSize;
+  StrokeBlockCodec codec;
+};
+
+// Coverage of an erase mask, stored as the tiles it has pixels in
+struct MaskPixels {
+  uint32_t position; // strokes saved under it
+  std::vector<SkIRect> tiles;
+  std::vector<uint8_t> coverage; // of each tile, row by row
+
+  void clear();
+};
+
+// Strokes decoded from a block, their points and widths one after another,
+// or the mask of a mask block
+struct StrokeBatch {
+  std::vector<SkColor> colors;
+  std::vector<uint32_t> lengths;
+  std::vector<SkPoint> points;
+  std::vector<float> widths;
+
+  bool isMask = false;
+  MaskPixels mask;
+
+  void clear();
+};
+
+// Masks go in the order they are stacked. Blocks are left uncompressed,
+// compressing them is left to the thread that writes the file.
+std::vector<uint8_t> encodeStrokes(StrokeStore &store,
+                                   const std::vector<StrokeId> &strokes,
+                                   const std::vector<MaskPixels> &masks,
+                                   uint64_t journalSequence);
+std::vector<uint8_t> compressBlocks(std::vector<uint8_t> &&raw);
+bool writeStrokeFile(const char *path, const std::vector<uint8_t> &bytes);
+bool saveStrokes(const char *path, StrokeStore &store,
+                 const std::vector<StrokeId> &strokes,
+                 const std::vector<MaskPixels> &masks);
+
+// Maps the file and decodes its blocks in order, straight from the mapping
+// unless they are compressed
+class StrokeFileReader {
+private:
+  const uint8_t *data = nullptr;
+  size_t size = 0;
+
+  const SkColor *styles = nullptr;
+  StrokeFileHeader header = {};
+  uint32_t blocksRead = 0;
+  size_t cursor = 0;
+
+  std::vector<uint8_t> scratch;
+
+public:
+  StrokeFileReader(const char *path);
+  ~StrokeFileReader();
+
+  bool isOpen() { return this->data != nullptr; }
+  uint32_t strokeCount() { return this->header.strokeCount; }
+  uint64_t journalSequence() { return this->header.journalSequence; }
+  bool next(StrokeBatch &batch);
+};
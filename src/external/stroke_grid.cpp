@@ -0,0 +1,189 @@
+// Copyright (c) 2024 DavidDeadly
+#include "stroke_grid.h"
+
+#include <algorithm>
+#include <cmath>
+
+void StrokeGrid::init(int width, int height, int cellSize) {
+  this->cellSize = cellSize;
+  this->columns = (width + cellSize - 1) / cellSize + 1;
+  this->rows = (height + cellSize - 1) / cellSize + 1;
+
+  this->cells.assign(this->columns * this->rows, {});
+}
+
+void StrokeGrid::clear() {
+  for (auto &cell : this->cells)
+    cell.clear();
+}
+
+SkIRect StrokeGrid::cellsFor(const SkRect &bounds) {
+  int left = std::floor(bounds.left() / this->cellSize);
+  int top = std::floor(bounds.top() / this->cellSize);
+  int right = std::floor(bounds.right() / this->cellSize);
+  int bottom = std::floor(bounds.bottom() / this->cellSize);
+
+  return SkIRect::MakeLTRB(std::clamp(left, 0, this->columns - 1),
+                           std::clamp(top, 0, this->rows - 1),
+                           std::clamp(right, 0, this->columns - 1),
+                           std::clamp(bottom, 0, this->rows - 1));
+}
+
+SkRect StrokeGrid::segmentBounds(const SkPoint *points, const float *widths,
+                                 uint32_t segment, float padding) {
+  const SkPoint &start = points[segment - 1];
+  const SkPoint &end = points[segment];
+  // the curve drawn for the segment strays up to a third of its length
+  float margin = SkPoint::Distance(start, end) / 3 +
+                 std::max(widths[segment - 1], widths[segment]) / 2 + padding;
+
+  SkRect bounds = SkRect::MakeLTRB(
+      std::min(start.fX, end.fX), std::min(start.fY, end.fY),
+      std::max(start.fX, end.fX), std::max(start.fY, end.fY));
+
+  return bounds.makeOutset(margin, margin);
+}
+
+void StrokeGrid::insertSegment(StrokeId stroke, const SkPoint *points,
+                               const float *widths, uint32_t segment,
+                               float padding) {
+  SkRect bounds = this->segmentBounds(points, widths, segment, padding);
+  SkIRect range = this->cellsFor(bounds);
+
+  for (int row = range.top(); row <= range.bottom(); row++)
+    for (int column = range.left(); column <= range.right(); column++)
+      this->cells[row * this->columns + column].push_back({stroke, segment});
+}
+
+void StrokeGrid::insertStroke(StrokeId stroke, const SkPoint *points,
+                              const float *widths, uint32_t length,
+                              float padding) {
+  for (uint32_t segment = 1; segment < length; segment++)
+    this->insertSegment(stroke, points, widths, segment, padding);
+}
+
+void StrokeGrid::removeStroke(StrokeId stroke, const SkPoint *points,
+                              const float *widths, uint32_t length,
+                              float padding) {
+  for (uint32_t segment = 1; segment < length; segment++) {
+    SkRect bounds = this->segmentBounds(points, widths, segment, padding);
+    SkIRect range = this->cellsFor(bounds);
+
+    for (int row = range.top(); row <= range.bottom(); row++)
+      for (int column = range.left(); column <= range.right(); column++)
+        std::erase_if(this->cells[row * this->columns + column],
+                      [stroke](const GridEntry &entry) {
+                        return entry.stroke == stroke;
+                      });
+  }
+}
+
+// The piece keeping a segment of the stroke it was cut from, if any
+static const StrokePiece *pieceOf(const StrokePiece *pieces, uint32_t count,
+                                  uint32_t segment) {
+  const StrokePiece *piece = std::partition_point(
+      pieces, pieces + count,
+      [segment](const StrokePiece &piece) { return piece.first < segment; });
+  if (piece == pieces)
+    return nullptr;
+
+  piece--;
+  bool isKept = segment < piece->first + piece->length;
+  return isKept ? piece : nullptr;
+}
+
+void StrokeGrid::splitStroke(StrokeId stroke, const SkRect &bounds,
+                             const StrokePiece *pieces, uint32_t count) {
+  SkIRect range = this->cellsFor(bounds);
+
+  for (int row = range.top(); row <= range.bottom(); row++) {
+    for (int column = range.left(); column <= range.right(); column++) {
+      std::vector<GridEntry> &cell = this->cells[row * this->columns + column];
+
+      // a cell lists a stroke's segments mostly in order, the piece of the
+      // last one is tried before searching
+      const StrokePiece *piece = nullptr;
+      size_t kept = 0;
+      for (GridEntry entry : cell) {
+        if (entry.stroke == stroke) {
+          bool isInPiece = piece && entry.segment > piece->first &&
+                           entry.segment < piece->first + piece->length;
+          if (!isInPiece)
+            piece = pieceOf(pieces, count, entry.segment);
+          if (!piece)
+            continue;
+
+          entry = {piece->stroke, entry.segment - piece->first};
+        }
+
+        cell[kept++] = entry;
+      }
+      cell.resize(kept);
+    }
+  }
+}
+
+void StrokeGrid::joinStroke(StrokeId stroke, const SkPoint *points,
+                            const float *widths, uint32_t length,
+                            float padding, const StrokePiece *pieces,
+                            uint32_t count) {
+  SkRect bounds = SkRect::MakeEmpty();
+  for (uint32_t segment = 1; segment < length; segment++)
+    bounds.join(this->segmentBounds(points, widths, segment, padding));
+  SkIRect range = this->cellsFor(bounds);
+
+  for (int row = range.top(); row <= range.bottom(); row++) {
+    for (int column = range.left(); column <= range.right(); column++) {
+      for (GridEntry &entry : this->cells[row * this->columns + column]) {
+        for (uint32_t i = 0; i < count; i++) {
+          if (entry.stroke != pieces[i].stroke)
+            continue;
+
+          entry = {stroke, entry.segment + pieces[i].first};
+          break;
+        }
+      }
+    }
+  }
+
+  for (uint32_t segment = 1; segment < length; segment++)
+    if (!pieceOf(pieces, count, segment))
+      this->insertSegment(stroke, points, widths, segment, padding);
+}
+
+const std::vector<GridEntry> &StrokeGrid::candidatesAt(const SkPoint &point) {
+  SkRect bounds = SkRect::MakeLTRB(point.fX, point.fY, point.fX, point.fY);
+  SkIRect cell = this->cellsFor(bounds);
+
+  return this->cells[cell.top() * this->columns + cell.left()];
+}
+
+// A cell is crossed when the path passes within half its diagonal of its
+// center, which may take a cell it only grazes
+void StrokeGrid::candidatesAlong(const SkPoint &from, const SkPoint &to,
+                                 std::vector<GridEntry> &candidates) {
+  SkPoint ends[2] = {from, to};
+  SkRect bounds;
+  bounds.setBounds(ends, 2);
+  SkIRect range = this->cellsFor(bounds);
+
+  SkVector path = to - from;
+  float lengthSquared = path.dot(path);
+  float reach = this->cellSize / std::sqrt(2.0f);
+
+  for (int row = range.top(); row <= range.bottom(); row++) {
+    for (int column = range.left(); column <= range.right(); column++) {
+      SkPoint center = SkPoint::Make((column + 0.5f) * this->cellSize,
+                                     (row + 0.5f) * this->cellSize);
+      float t = lengthSquared > 0 ? (center - from).dot(path) / lengthSquared
+                                  : 0;
+      SkPoint closest = from + path * std::clamp(t, 0.0f, 1.0f);
+      if (SkPoint::Distance(closest, center) > reach)
+        continue;
+
+      const std::vector<GridEntry> &cell =
+          this->cells[row * this->columns + column];
+      candidates.insert(candidates.end(), cell.begin(), cell.end());
+    }
+  }
+}
@@ -0,0 +1,56 @@
+// Copyright (c) 2024 DavidDeadly
+#pragma once
+
+#include <vector>
+
+#include "include/core/SkPoint.h"
+#include "include/core/SkRect.h"
+
+#include "strokes.h"
+
+struct GridEntry {
+  StrokeId stroke;
+  uint32_t segment; // index of the segment's end point in the stroke
+};
+
+// Uniform grid binning stroke segments by their bounds, so the eraser only
+// tests the segments around the cursor instead of every stroke
+class StrokeGrid {
+private:
+  int cellSize;
+  int columns = 0;
+  int rows = 0;
+
+  std::vector<std::vector<GridEntry>> cells;
+
+  SkIRect cellsFor(const SkRect &bounds);
+  SkRect segmentBounds(const SkPoint *points, const float *widths,
+                       uint32_t segment, float padding);
+
+public:
+  void init(int width, int height, int cellSize);
+  void clear();
+
+  // segments are binned by their bounds grown by how far their curve can
+  // stray, the wider of their ends' half widths and the padding
+  void insertSegment(StrokeId stroke, const SkPoint *points,
+                     const float *widths, uint32_t segment, float padding);
+  void insertStroke(StrokeId stroke, const SkPoint *points,
+                    const float *widths, uint32_t length, float padding);
+  void removeStroke(StrokeId stroke, const SkPoint *points,
+                    const float *widths, uint32_t length, float padding);
+  // a stroke cut apart hands the entries of the segments its pieces kept
+  // over to them, walking only the cells its bounds cover, and joining it
+  // back takes them again and adds the ones cut out. Pieces go in order.
+  void splitStroke(StrokeId stroke, const SkRect &bounds,
+                   const StrokePiece *pieces, uint32_t count);
+  void joinStroke(StrokeId stroke, const SkPoint *points, const float *widths,
+                  uint32_t length, float padding, const StrokePiece *pieces,
+                  uint32_t count);
+
+  const std::vector<GridEntry> &candidatesAt(const SkPoint &point);
+  // entries of every cell a path from one point to another crosses, those
+  // in several of them are added once per cell
+  void candidatesAlong(const SkPoint &from, const SkPoint &to,
+                       std::vector<GridEntry> &candidates);
+};
@@ -0,0 +1,354 @@
+// Copyright (c) 2024 DavidDeadly
+#include "strokes.h"
+
+#include <algorithm>
+#include <cmath>
+
+#include "curves.h"
+
+StrokeId StrokeStore::create(uint16_t style) {
+  StrokeId id = this->offsets.size();
+
+  if (!this->freeIds.empty()) {
+    id = this->freeIds.back();
+    this->freeIds.pop_back();
+  } else {
+    this->offsets.push_back(0);
+    this->lengths.push_back(0);
+    this->styles.push_back(0);
+    this->bounds.push_back(SkRect::MakeEmpty());
+    this->generations.push_back(0);
+  }
+
+  this->offsets[id] = this->points.size();
+  this->lengths[id] = 0;
+  this->styles[id] = style;
+  this->bounds[id] = SkRect::MakeEmpty();
+
+  return id;
+}
+
+// Area a segment can cover: its curve strays up to a third of its length
+// from it, and the width goes around that
+static SkRect segmentBounds(SkPoint start, float startWidth, SkPoint end,
+                            float endWidth) {
+  float margin = SkPoint::Distance(start, end) / 3 +
+                 std::max(startWidth, endWidth) / 2;
+
+  SkRect bounds = SkRect::MakeLTRB(
+      std::min(start.fX, end.fX), std::min(start.fY, end.fY),
+      std::max(start.fX, end.fX), std::max(start.fY, end.fY));
+
+  return bounds.makeOutset(margin, margin);
+}
+
+void StrokeStore::append(StrokeId id, SkPoint point, float width) {
+  uint32_t offset = this->offsets[id];
+  uint32_t length = this->lengths[id];
+
+  // only the last stroke of the buffer can grow in place
+  bool isLast = offset + length == this->points.size();
+  if (!isLast) {
+    this->offsets[id] = this->points.size();
+    this->garbage += length;
+
+    for (uint32_t i = 0; i < length; i++) {
+      this->points.push_back(this->points[offset + i]);
+      this->widths.push_back(this->widths[offset + i]);
+    }
+  }
+
+  this->points.push_back(point);
+  this->widths.push_back(width);
+  this->lengths[id]++;
+
+  SkRect &strokeBounds = this->bounds[id];
+  if (length == 0) {
+    float radius = width / 2;
+    strokeBounds = SkRect::MakeLTRB(point.fX - radius, point.fY - radius,
+                                    point.fX + radius, point.fY + radius);
+    return;
+  }
+
+  uint32_t last = this->points.size() - 2;
+  strokeBounds.join(segmentBounds(this->points[last], this->widths[last],
+                                  point, width));
+}
+
+// Replaces the points of a stroke with fewer ones, in its own range. The
+// ones left over at its end are freed if it is the last stroke of the
+// buffer, or counted as garbage otherwise.
+void StrokeStore::rewrite(StrokeId id, const SkPoint *points,
+                          const float *widths, uint32_t length) {
+  uint32_t offset = this->offsets[id];
+  uint32_t previousLength = this->lengths[id];
+  if (length == 0 || length > previousLength)
+    return;
+
+  std::copy(points, points + length, this->points.begin() + offset);
+  std::copy(widths, widths + length, this->widths.begin() + offset);
+  this->lengths[id] = length;
+
+  bool isLast = offset + previousLength == this->points.size();
+  if (isLast) {
+    this->points.resize(offset + length);
+    this->widths.resize(offset + length);
+  } else {
+    this->garbage += previousLength - length;
+  }
+
+  SkRect &strokeBounds = this->bounds[id];
+  float radius = widths[0] / 2;
+  strokeBounds = SkRect::MakeLTRB(points[0].fX - radius, points[0].fY - radius,
+                                  points[0].fX + radius, points[0].fY + radius);
+
+  for (uint32_t i = 1; i < length; i++)
+    strokeBounds.join(
+        segmentBounds(points[i - 1], widths[i - 1], points[i], widths[i]));
+
+  if (this->cachedId == id)
+    this->cachedId = NO_STROKE;
+}
+
+// Points released later as the stroke's are counted as garbage though the
+// other still uses them, which compacts a bit early and gives each its own
+// copy
+StrokeId StrokeStore::split(StrokeId id, uint32_t first, uint32_t length) {
+  StrokeId piece = this->create(this->styles[id]);
+  this->offsets[piece] = this->offsets[id] + first;
+  this->lengths[piece] = length;
+
+  // a piece can keep most of a long stroke, its points are grown by the
+  // widest of them and the stray of its longest segment all at once, a bit
+  // looser than joining every segment's but without a root for each
+  const SkPoint *points = this->pointsOf(piece);
+  const float *widths = this->widthsOf(piece);
+  float widest = widths[0];
+  float longest = 0;
+  for (uint32_t i = 1; i < length; i++) {
+    SkVector step = points[i] - points[i - 1];
+    widest = std::max(widest, widths[i]);
+    longest = std::max(longest, step.fX * step.fX + step.fY * step.fY);
+  }
+
+  float margin = std::sqrt(longest) / 3 + widest / 2;
+  SkRect &pieceBounds = this->bounds[piece];
+  pieceBounds.setBounds(points, length);
+  pieceBounds.outset(margin, margin);
+
+  return piece;
+}
+
+void StrokeStore::release(StrokeId id) {
+  this->garbage += this->lengths[id];
+  this->lengths[id] = 0;
+  this->generations[id]++;
+  this->freeIds.push_back(id);
+
+  if (this->cachedId == id)
+    this->cachedId = NO_STROKE;
+
+  bool isMostlyGarbage = this->garbage > this->points.size() / 2;
+  if (isMostlyGarbage)
+    this->compact();
+}
+
+// A piece dropped once the stroke it was cut from is back frees none of
+// the points that stroke still draws, unless a compaction copied them apart
+void StrokeStore::releasePiece(StrokeId id, StrokeId from) {
+  uint32_t offset = this->offsets[id];
+  uint32_t fromOffset = this->offsets[from];
+  bool isShared = offset >= fromOffset &&
+                  offset + this->lengths[id] <=
+                      fromOffset + this->lengths[from];
+  if (isShared)
+    this->lengths[id] = 0;
+
+  this->release(id);
+}
+
+void StrokeStore::clear() {
+  this->points.clear();
+  this->widths.clear();
+  this->offsets.clear();
+  this->lengths.clear();
+  this->styles.clear();
+  this->bounds.clear();
+  this->generations.clear();
+  this->freeIds.clear();
+  this->garbage = 0;
+  this->cachedId = NO_STROKE;
+}
+
+// Moves the points of the remaining strokes together, dropping the ones of
+// released strokes. Points shared by split strokes can be counted as
+// garbage twice, so it is only an estimate of what is left.
+void StrokeStore::compact() {
+  size_t kept = this->points.size() - std::min(this->garbage,
+                                               this->points.size());
+  std::vector<SkPoint> compacted;
+  std::vector<float> compactedWidths;
+  compacted.reserve(kept);
+  compactedWidths.reserve(kept);
+
+  for (StrokeId id = 0; id < this->offsets.size(); id++) {
+    uint32_t offset = this->offsets[id];
+    uint32_t end = offset + this->lengths[id];
+    this->offsets[id] = compacted.size();
+
+    compacted.insert(compacted.end(), this->points.begin() + offset,
+                     this->points.begin() + end);
+    compactedWidths.insert(compactedWidths.end(),
+                           this->widths.begin() + offset,
+                           this->widths.begin() + end);
+  }
+
+  this->points.swap(compacted);
+  this->widths.swap(compactedWidths);
+  this->garbage = 0;
+}
+
+SkRect StrokeStore::boundsOfSegment(StrokeId id, uint32_t segment) {
+  const SkPoint *points = this->pointsOf(id);
+  const float *widths = this->widthsOf(id);
+
+  return segmentBounds(points[segment - 1], widths[segment - 1],
+                       points[segment], widths[segment]);
+}
+
+StrokeHandle StrokeStore::handle(StrokeId id) {
+  return {id, this->generations[id]};
+}
+
+bool StrokeStore::isCurrent(StrokeHandle handle) {
+  return handle.id < this->generations.size() &&
+         this->generations[handle.id] == handle.generation;
+}
+
+int StrokeStore::findStyle(SkColor color) {
+  for (size_t style = 0; style < this->paints.size(); style++)
+    if (this->paints[style].getColor() == color)
+      return style;
+
+  return -1;
+}
+
+uint16_t StrokeStore::addStyle(const SkPaint &paint) {
+  this->paints.push_back(paint);
+  return this->paints.size() - 1;
+}
+
+const float MAX_TURN_COS = 0.87f; // about 30 degrees
+const int MAX_SPLITS = 2;
+
+// Band of the width of the stroke along a curve, its sides offset from the
+// curve's handles. Curves turning too much for that are split first. It goes
+// in the same direction as the circles so nonzero filling unions them.
+static void addRibbon(SkPath &outline, const StrokeCurve &curve,
+                      float startRadius, float endRadius, int splits) {
+  SkVector chord = curve.end - curve.start;
+  if (!chord.normalize())
+    return;
+
+  SkVector startTangent = curve.control1 - curve.start;
+  SkVector endTangent = curve.end - curve.control2;
+  if (!startTangent.normalize())
+    startTangent = chord;
+  if (!endTangent.normalize())
+    endTangent = chord;
+
+  bool isSharp = startTangent.dot(endTangent) < MAX_TURN_COS;
+  if (isSharp && splits > 0) {
+    StrokeCurve first, second;
+    splitCurve(curve, first, second);
+
+    float middleRadius = (startRadius + endRadius) / 2;
+    addRibbon(outline, first, startRadius, middleRadius, splits - 1);
+    addRibbon(outline, second, middleRadius, endRadius, splits - 1);
+    return;
+  }
+
+  SkVector startOffset =
+      SkVector::Make(-startTangent.fY, startTangent.fX) * startRadius;
+  SkVector endOffset =
+      SkVector::Make(-endTangent.fY, endTangent.fX) * endRadius;
+
+  outline.moveTo(curve.start - startOffset);
+  outline.cubicTo(curve.control1 - startOffset, curve.control2 - endOffset,
+                  curve.end - endOffset);
+  outline.lineTo(curve.end + endOffset);
+  outline.cubicTo(curve.control2 + endOffset, curve.control1 + startOffset,
+                  curve.start + startOffset);
+  outline.close();
+}
+
+static void addSegmentOutline(SkPath &outline, const SkPoint *points,
+                              const float *widths, uint32_t length,
+                              uint32_t segment) {
+  StrokeCurve curve = strokeCurve(points, length, segment);
+  addRibbon(outline, curve, widths[segment - 1] / 2, widths[segment] / 2,
+            MAX_SPLITS);
+}
+
+// The filled shape of a stroke, a round cap at every point joined by bands
+// following the curve through them and the width
+const SkPath &StrokeStore::outline(StrokeId id) {
+  this->buildOutline(id, this->builtOutline);
+  return this->builtOutline;
+}
+
+// Into a path of the caller's, so outlines can be built on several threads
+void StrokeStore::buildOutline(StrokeId id, SkPath &outline) {
+  uint32_t length = this->lengths[id];
+  const SkPoint *strokePoints = this->pointsOf(id);
+  const float *strokeWidths = this->widthsOf(id);
+
+  outline.rewind();
+  for (uint32_t i = 0; i < length; i++) {
+    SkPoint point = strokePoints[i];
+    outline.addCircle(point.fX, point.fY, strokeWidths[i] / 2);
+
+    if (i > 0)
+      addSegmentOutline(outline, strokePoints, strokeWidths, length, i);
+  }
+}
+
+// A segment's curve is only settled once the point after it is known, so
+// the live stroke is drawn as the part that is, which each new point
+// extends in place instead of it being built again every frame, plus its
+// last segment on its own
+const SkPath &StrokeStore::growingOutline(StrokeId id) {
+  uint32_t length = this->lengths[id];
+
+  bool isCached = this->cachedId == id && this->cachedLength <= length;
+  if (!isCached) {
+    this->cachedOutline.rewind();
+    this->cachedId = id;
+    this->cachedLength = 0;
+  }
+
+  const SkPoint *strokePoints = this->pointsOf(id);
+  const float *strokeWidths = this->widthsOf(id);
+  for (uint32_t i = this->cachedLength; i < length; i++) {
+    SkPoint point = strokePoints[i];
+    this->cachedOutline.addCircle(point.fX, point.fY, strokeWidths[i] / 2);
+
+    if (i > 1)
+      addSegmentOutline(this->cachedOutline, strokePoints, strokeWidths,
+                        length, i - 1);
+  }
+
+  this->cachedLength = length;
+  return this->cachedOutline;
+}
+
+const SkPath &StrokeStore::lastSegmentOutline(StrokeId id) {
+  uint32_t length = this->lengths[id];
+
+  this->tailOutline.rewind();
+  if (length > 1)
+    addSegmentOutline(this->tailOutline, this->pointsOf(id),
+                      this->widthsOf(id), length, length - 1);
+
+  return this->tailOutline;
+}
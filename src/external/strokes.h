@@ -0,0 +1,95 @@
+// Copyright (c) 2024 DavidDeadly
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "include/core/SkColor.h"
+#include "include/core/SkPaint.h"
+#include "include/core/SkPath.h"
+#include "include/core/SkPoint.h"
+#include "include/core/SkRect.h"
+
+typedef uint32_t StrokeId;
+const StrokeId NO_STROKE = UINT32_MAX;
+
+// Ids are reused once a stroke is released, the generation tells a stale
+// handle apart from the stroke that took its id
+struct StrokeHandle {
+  StrokeId id = NO_STROKE;
+  uint32_t generation = 0;
+};
+
+// What is left of a stroke cut apart, a stroke over a range of its points
+struct StrokePiece {
+  StrokeId stroke;
+  uint32_t first; // point of the cut stroke it starts at
+  uint32_t length;
+};
+
+// Every stroke lives in a struct of arrays: the points of all strokes share
+// one contiguous buffer, with the pen width at each point alongside, and a
+// stroke is a range of them plus an index into a small table of deduplicated
+// paints. SkPaths are only built to draw them.
+class StrokeStore {
+private:
+  std::vector<SkPoint> points;
+  std::vector<float> widths;
+
+  std::vector<uint32_t> offsets;
+  std::vector<uint32_t> lengths;
+  std::vector<uint16_t> styles;
+  std::vector<SkRect> bounds;
+  std::vector<uint32_t> generations;
+
+  std::vector<StrokeId> freeIds;
+  size_t garbage = 0;
+
+  std::vector<SkPaint> paints;
+
+  SkPath builtOutline;
+  SkPath tailOutline;
+
+  // the live stroke's outline but its last segment, extended in place while
+  // the stroke keeps growing
+  SkPath cachedOutline;
+  StrokeId cachedId = NO_STROKE;
+  uint32_t cachedLength = 0;
+
+  void compact();
+
+public:
+  StrokeId create(uint16_t style);
+  void append(StrokeId id, SkPoint point, float width);
+  void rewrite(StrokeId id, const SkPoint *points, const float *widths,
+               uint32_t length);
+  // the new stroke shares the points of the other one instead of copying
+  // them, neither can grow or be rewritten after it
+  StrokeId split(StrokeId id, uint32_t first, uint32_t length);
+  void release(StrokeId id);
+  void releasePiece(StrokeId id, StrokeId from);
+  void clear();
+
+  StrokeHandle handle(StrokeId id);
+  bool isCurrent(StrokeHandle handle);
+
+  int findStyle(SkColor color);
+  uint16_t addStyle(const SkPaint &paint);
+
+  const SkPoint *pointsOf(StrokeId id) {
+    return this->points.data() + this->offsets[id];
+  }
+
+  const float *widthsOf(StrokeId id) {
+    return this->widths.data() + this->offsets[id];
+  }
+
+  uint32_t length(StrokeId id) { return this->lengths[id]; }
+  const SkPaint &paint(StrokeId id) { return this->paints[styles[id]]; }
+  const SkRect &boundsOf(StrokeId id) { return this->bounds[id]; }
+  SkRect boundsOfSegment(StrokeId id, uint32_t segment);
+  const SkPath &outline(StrokeId id);
+  void buildOutline(StrokeId id, SkPath &outline);
+  const SkPath &growingOutline(StrokeId id);
+  const SkPath &lastSegmentOutline(StrokeId id);
+};
@@ -3,12 +3,17 @@
 
 #include <GL/gl.h>
 #include <GLFW/glfw3.h>
+#include <algorithm>
+#include <cfloat>
 #include <iostream>
 #include <unordered_map>
 #define STB_IMAGE_IMPLEMENTATION
 #include "stb_image.h"
 
+#include "buffer_age.h"
 #include "drawing.h"
+#include "log.h"
+#include "session_recording.h"
 #include "imgui.h"
 #include "imgui_impl_glfw.h"
 #include "imgui_impl_opengl3.h"
@@ -17,6 +22,9 @@ static void glfw_error_callback(int error, const char *description) {
   fprintf(stderr, "GLFW Error %d: %s\n", error, description);
 }
 
+// Events reaching the canvas are written here while a session is recorded
+static SessionRecorder *sessionRecorder = NULL;
+
 GLFWWindowManager::GLFWWindowManager() {
   std::cout << "Running GLFW: " << glfwGetVersionString() << std::endl;
 
@@ -38,6 +46,10 @@ GLFWWindowManager::GLFWWindowManager() {
 }
 
 void GLFWWindowManager::cleanUp() {
+  delete sessionRecorder;
+  sessionRecorder = NULL;
+  delete this->replay;
+
   ImGui_ImplOpenGL3_Shutdown();
   ImGui_ImplGlfw_Shutdown();
   ImGui::DestroyContext();
@@ -78,7 +90,7 @@ void GLFWWindowManager::createWindow(IDrawingManager *pointer) {
       stbi_load("resources/ipen.png", &icon[0].width, &icon[0].height, 0, 4);
 
   if (!icon[0].pixels) {
-    std::cerr << "Failed to load icon: " << stbi_failure_reason() << std::endl;
+    LOG_WARNING("window", "Failed to load icon: %s", stbi_failure_reason());
     return;
   }
 
@@ -88,13 +100,42 @@ void GLFWWindowManager::createWindow(IDrawingManager *pointer) {
 }
 
 static float pen_color[4] = {1, 1, 1, 1};
+static int eraser_mode = ERASER_STROKES;
+static bool isProfilerOpen = false;
+
+// ImGui needs a couple of frames to settle after an input (hover, active
+// widgets), every event requests them and the loop idles once they are done
+const int SETTLE_FRAMES = 3;
+const double IDLE_TIMEOUT = 0.5;
+static int pendingFrames = SETTLE_FRAMES;
+
+// recording time played per frame when replaying as fast as possible
+const uint64_t REPLAY_FRAME_NS = 16666667;
+
+static void requestFrames() { pendingFrames = SETTLE_FRAMES; }
+
 std::unordered_map<int, Color> keyToColor = {
     {GLFW_KEY_W, WHITE}, {GLFW_KEY_Q, BLACK}, {GLFW_KEY_R, RED},
     {GLFW_KEY_G, GREEN}, {GLFW_KEY_B, BLUE},  {GLFW_KEY_A, YELLOW},
 };
 
-static void keyboardCallback(GLFWwindow *window, int key, int scancode,
-                             int action, int mods) {
+// Cursor samples are produced here, on the main thread, and drained by the
+// render loop together with the queues of the input threads
+static InputQueue cursorSamples;
+static std::vector<InputQueue *> inputQueues;
+
+// Samples that came before a command are drawn before it, so undoing right
+// after lifting the pen takes the whole stroke
+static void drainInput(IDrawingManager *drawingManager) {
+  drawingManager->processInput(cursorSamples);
+  for (InputQueue *queue : inputQueues)
+    drawingManager->processInput(*queue);
+}
+
+// Window events reach the canvas through these, live or from a replay
+static void dispatchKey(GLFWwindow *window, int key, int action, int mods) {
+  requestFrames();
+
   if (action != GLFW_PRESS)
     return;
 
@@ -103,20 +144,36 @@ static void keyboardCallback(GLFWwindow *window, int key, int scancode,
     return;
   }
 
+  if (key == GLFW_KEY_F3) {
+    isProfilerOpen = !isProfilerOpen;
+    return;
+  }
+
   IDrawingManager *drawingManager =
       static_cast<IDrawingManager *>(glfwGetWindowUserPointer(window));
+  drainInput(drawingManager);
 
   if (key == GLFW_KEY_R && mods == GLFW_MOD_CONTROL)
     return drawingManager->reset();
 
-  if (key == GLFW_KEY_Z && mods == GLFW_MOD_CONTROL)
-    return drawingManager->undo();
+  // the picker follows a color change being undone or redone
+  if (key == GLFW_KEY_Z && mods == GLFW_MOD_CONTROL) {
+    drawingManager->undo();
+    return drawingManager->readColor(pen_color);
+  }
 
   bool redoYCombination = key == GLFW_KEY_Y && mods == GLFW_MOD_CONTROL;
   bool redoZCombination =
       key == GLFW_KEY_Z && mods == GLFW_MOD_CONTROL + GLFW_MOD_SHIFT;
-  if (redoYCombination || redoZCombination)
-    return drawingManager->redo();
+  if (redoYCombination || redoZCombination) {
+    drawingManager->redo();
+    return drawingManager->readColor(pen_color);
+  }
+
+  if (key == GLFW_KEY_E) {
+    eraser_mode = (eraser_mode + 1) % (ERASER_PIXELS + 1);
+    return;
+  }
 
   bool hasColor = keyToColor.contains(key);
   if (hasColor) {
@@ -125,77 +182,346 @@ static void keyboardCallback(GLFWwindow *window, int key, int scancode,
   }
 }
 
-static void cursorCallBack(GLFWwindow *window, double xpos, double ypos) {
-  bool guiFocused = ImGui::IsWindowFocused(ImGuiFocusedFlags_AnyWindow);
-  if (guiFocused)
-    return;
+// Buttons are tracked from their events instead of asking GLFW, so a replay
+// sees the same state the recording did
+static bool isLeftDown = false;
+static bool isRightDown = false;
 
+static void pushCursorSample(GLFWwindow *window, double xpos, double ypos) {
   IDrawingManager *drawingManager =
       static_cast<IDrawingManager *>(glfwGetWindowUserPointer(window));
 
   if (!drawingManager) {
-    std::cerr << "No drawing manager found to process cursor movement"
-              << std::endl;
+    LOG_ERROR("window", "No drawing manager found to process cursor movement");
     return;
   }
 
-  bool isErasing =
-      glfwGetMouseButton(window, GLFW_MOUSE_BUTTON_RIGHT) == GLFW_PRESS;
-  if (isErasing) {
-    drawingManager->eraseStroke(xpos, ypos);
+  InputSample sample = {};
+  sample.timestamp = inputTimestamp();
+  sample.x = xpos;
+  sample.y = ypos;
+  sample.pressure = 1;
+  sample.tool = isRightDown ? TOOL_ERASER : TOOL_PEN;
+  sample.isDown = isRightDown || isLeftDown;
+
+  if (cursorSamples.push(sample))
+    return;
+
+  // this thread is also the consumer, so make room instead of waiting
+  drawingManager->processInput(cursorSamples);
+  cursorSamples.push(sample);
+}
+
+// Whether the toolbar has pointer events is decided when they happen and
+// recorded with them, a replay doesn't go through the toolbar
+static bool isGuiFocused() {
+  return ImGui::IsWindowFocused(ImGuiFocusedFlags_AnyWindow);
+}
+
+static void dispatchCursor(GLFWwindow *window, double xpos, double ypos,
+                           bool isForGui) {
+  requestFrames();
+
+  if (isForGui)
     return;
+
+  pushCursorSample(window, xpos, ypos);
+}
+
+static void dispatchButton(GLFWwindow *window, int button, int action,
+                           double xpos, double ypos, bool isForGui) {
+  requestFrames();
+
+  bool isPressed = action == GLFW_PRESS;
+  if (button == GLFW_MOUSE_BUTTON_LEFT)
+    isLeftDown = isPressed;
+  if (button == GLFW_MOUSE_BUTTON_RIGHT)
+    isRightDown = isPressed;
+
+  if (isForGui)
+    return;
+
+  pushCursorSample(window, xpos, ypos);
+}
+
+static void dispatchReset(GLFWwindow *window) {
+  IDrawingManager *drawingManager =
+      static_cast<IDrawingManager *>(glfwGetWindowUserPointer(window));
+
+  drainInput(drawingManager);
+  drawingManager->reset();
+}
+
+static void dispatchEvent(GLFWwindow *window, const SessionEvent &event) {
+  bool isForGui = event.mods & SESSION_FOR_GUI;
+
+  switch (event.type) {
+  case SESSION_CURSOR:
+    dispatchCursor(window, event.x, event.y, isForGui);
+    break;
+  case SESSION_BUTTON:
+    dispatchButton(window, event.code, event.action, event.x, event.y,
+                   isForGui);
+    break;
+  case SESSION_KEY:
+    dispatchKey(window, event.code, event.action, event.mods);
+    break;
+  case SESSION_COLOR:
+    requestFrames();
+    if (event.code >= 0 && event.code < 4)
+      pen_color[event.code] = event.x;
+    break;
+  case SESSION_ERASER:
+    requestFrames();
+    eraser_mode = event.code;
+    break;
+  case SESSION_RESET:
+    requestFrames();
+    dispatchReset(window);
+    break;
   }
+}
+
+static void recordEvent(SessionEventType type, double xpos, double ypos,
+                        int code, int action, int mods) {
+  if (sessionRecorder)
+    sessionRecorder->record(type, xpos, ypos, code, action, mods);
+}
+
+static void keyboardCallback(GLFWwindow *window, int key, int scancode,
+                             int action, int mods) {
+  double xpos, ypos;
+  glfwGetCursorPos(window, &xpos, &ypos);
+
+  recordEvent(SESSION_KEY, xpos, ypos, key, action, mods);
+  dispatchKey(window, key, action, mods);
+}
+
+static void cursorCallBack(GLFWwindow *window, double xpos, double ypos) {
+  bool isForGui = isGuiFocused();
 
-  bool isDrawing =
-      glfwGetMouseButton(window, GLFW_MOUSE_BUTTON_LEFT) == GLFW_PRESS;
-  drawingManager->drawLine(isDrawing, xpos, ypos);
+  recordEvent(SESSION_CURSOR, xpos, ypos, 0, 0,
+              isForGui ? SESSION_FOR_GUI : 0);
+  dispatchCursor(window, xpos, ypos, isForGui);
+}
+
+static void mouseButtonCallback(GLFWwindow *window, int button, int action,
+                                int mods) {
+  double xpos, ypos;
+  glfwGetCursorPos(window, &xpos, &ypos);
+  bool isForGui = isGuiFocused();
+
+  recordEvent(SESSION_BUTTON, xpos, ypos, button, action,
+              isForGui ? mods | SESSION_FOR_GUI : mods);
+  dispatchButton(window, button, action, xpos, ypos, isForGui);
+}
+
+// The toolbar's changes are recorded as what they did
+static void recordColor() {
+  for (int channel = 0; channel < 4; channel++)
+    recordEvent(SESSION_COLOR, pen_color[channel], 0, channel, 0, 0);
+}
+
+static void recordEraserMode() {
+  recordEvent(SESSION_ERASER, 0, 0, eraser_mode, 0, 0);
+}
+
+static void scrollCallback(GLFWwindow *window, double xoffset,
+                           double yoffset) {
+  requestFrames();
+}
+
+static void charCallback(GLFWwindow *window, unsigned int codepoint) {
+  requestFrames();
+}
+
+static void refreshCallback(GLFWwindow *window) { requestFrames(); }
+
+void GLFWWindowManager::attachInput(InputQueue *queue) {
+  inputQueues.push_back(queue);
+}
+
+// Safe to call from any thread, wakes the loop when it is idle
+void GLFWWindowManager::wake() { glfwPostEmptyEvent(); }
+
+void GLFWWindowManager::recordSession(const char *path) {
+  delete sessionRecorder;
+  sessionRecorder = new SessionRecorder(path);
+}
+
+void GLFWWindowManager::replaySession(const char *path, bool isRealtime) {
+  this->replay = new SessionReader(path);
+  this->isReplayRealtime = isRealtime;
+  this->hasNextEvent = this->replay->next(this->nextEvent);
+}
+
+// Feeds the recorded events that are due through the same path as live
+// ones. At recorded speed they are due on the wall clock, as fast as
+// possible each frame plays the next frame interval of the recording,
+// skipping over the time nothing happened.
+void GLFWWindowManager::replayEvents() {
+  uint64_t now = inputTimestamp();
+  uint64_t replayedUntil = now - this->replayStart;
+
+  if (!this->isReplayRealtime) {
+    this->replayClock = std::max(this->replayClock + REPLAY_FRAME_NS,
+                                 this->nextEvent.timestamp);
+    replayedUntil = this->replayClock;
+  }
+
+  while (this->hasNextEvent && this->nextEvent.timestamp <= replayedUntil) {
+    dispatchEvent(this->window, this->nextEvent);
+
+    uint64_t dueAt = now;
+    if (this->isReplayRealtime)
+      dueAt = this->replayStart + this->nextEvent.timestamp;
+
+    this->frameEvents.push_back(dueAt);
+    this->hasNextEvent = this->replay->next(this->nextEvent);
+  }
+
+  bool isOver = !this->hasNextEvent && this->frameEvents.empty();
+  if (isOver)
+    glfwSetWindowShouldClose(this->window, GL_TRUE);
+}
+
+// Waits for events while idle, but never past the next replayed one
+void GLFWWindowManager::waitEvents() {
+  double timeout = IDLE_TIMEOUT;
+
+  if (this->replay && this->hasNextEvent) {
+    uint64_t dueAt = this->replayStart + this->nextEvent.timestamp;
+    uint64_t now = inputTimestamp();
+
+    timeout = 0;
+    if (this->isReplayRealtime && dueAt > now)
+      timeout = std::min(IDLE_TIMEOUT, (dueAt - now) / 1e9);
+  }
+
+  if (timeout > 0)
+    glfwWaitEventsTimeout(timeout);
+  else
+    glfwPollEvents();
+}
+
+// Latency is counted from when an event was due to the swap showing it
+void GLFWWindowManager::measureFrame(uint64_t frameStart) {
+  if (!this->replay)
+    return;
+
+  uint64_t swapped = inputTimestamp();
+  for (uint64_t dueAt : this->frameEvents)
+    this->eventLatency.add((swapped - dueAt) / 1e6);
+
+  this->frameEvents.clear();
+  this->frameTimes.add((swapped - frameStart) / 1e6);
+}
+
+void GLFWWindowManager::reportReplay() {
+  flushLog();
+  std::cout << "Replay finished" << std::endl;
+  this->eventLatency.print(std::cout, "Event latency");
+  this->frameTimes.print(std::cout, "Frame time");
 }
 
 void GLFWWindowManager::setUpListeners() {
   glfwSetKeyCallback(window, keyboardCallback);
   glfwSetCursorPosCallback(window, cursorCallBack);
+  glfwSetMouseButtonCallback(window, mouseButtonCallback);
+  glfwSetScrollCallback(window, scrollCallback);
+  glfwSetCharCallback(window, charCallback);
+  glfwSetWindowRefreshCallback(window, refreshCallback);
 
   ImGui_ImplGlfw_InitForOpenGL(this->window, true);
 }
 
+static ImVec4 guiBounds(ImDrawData *drawData) {
+  ImVec4 bounds = {FLT_MAX, FLT_MAX, -FLT_MAX, -FLT_MAX};
+
+  for (const ImDrawList *drawList : drawData->CmdLists) {
+    for (const ImDrawCmd &command : drawList->CmdBuffer) {
+      bounds.x = std::min(bounds.x, command.ClipRect.x);
+      bounds.y = std::min(bounds.y, command.ClipRect.y);
+      bounds.z = std::max(bounds.z, command.ClipRect.z);
+      bounds.w = std::max(bounds.w, command.ClipRect.w);
+    }
+  }
+
+  return bounds;
+}
+
 void GLFWWindowManager::render() {
   glfwSwapInterval(1);
   IDrawingManager *drawingManager =
       static_cast<IDrawingManager *>(glfwGetWindowUserPointer(window));
 
   if (!drawingManager) {
-    std::cerr << "No drawing manager found to start rendering cycle"
-              << std::endl;
+    LOG_ERROR("window", "No drawing manager found to start rendering cycle");
     return;
   }
 
+  ImVec4 lastGuiBounds = {0, 0, 0, 0};
+
   ImGuiIO &io = ImGui::GetIO();
   (void)io;
   io.ConfigFlags |=
       ImGuiConfigFlags_NavEnableKeyboard; // Enable Keyboard Controls
 
+  this->replayStart = inputTimestamp();
+
   while (!glfwWindowShouldClose(window)) {
-    drawingManager->display();
+    if (this->replay)
+      this->replayEvents();
+
+    this->profiler.beginFrame();
+    this->profiler.beginStage(STAGE_INPUT);
+
+    this->profiler.addInput(drawingManager->processInput(cursorSamples));
+    for (InputQueue *queue : inputQueues)
+      this->profiler.addInput(drawingManager->processInput(*queue));
+
+    this->profiler.endStage(STAGE_INPUT);
+
+    bool isIconified = glfwGetWindowAttrib(window, GLFW_ICONIFIED) != 0;
+    bool isIdle = pendingFrames == 0 && !drawingManager->needsRedraw();
 
-    if (glfwGetWindowAttrib(window, GLFW_ICONIFIED) != 0) {
-      ImGui_ImplGlfw_Sleep(10);
+    if (isIconified || isIdle) {
+      this->waitEvents();
       continue;
     }
 
+    uint64_t frameStart = inputTimestamp();
+
     // Start the Dear ImGui frame
+    this->profiler.beginStage(STAGE_GUI_BUILD);
     ImGui_ImplOpenGL3_NewFrame();
     ImGui_ImplGlfw_NewFrame();
     ImGui::NewFrame();
 
     drawingManager->changeColor(pen_color);
+    drawingManager->setEraserMode((EraserMode)eraser_mode);
 
     {
       ImGui::Begin("Toolbar");
 
-      ImGui::ColorEdit4("Pen color", pen_color);
-
-      if (ImGui::Button("Reset"))
-        drawingManager->reset();
+      if (ImGui::ColorEdit4("Pen color", pen_color))
+        recordColor();
+
+      ImGui::Text("Eraser (E):");
+      ImGui::SameLine();
+      if (ImGui::RadioButton("Strokes", &eraser_mode, ERASER_STROKES))
+        recordEraserMode();
+      ImGui::SameLine();
+      if (ImGui::RadioButton("Segments", &eraser_mode, ERASER_SEGMENTS))
+        recordEraserMode();
+      ImGui::SameLine();
+      if (ImGui::RadioButton("Pixels", &eraser_mode, ERASER_PIXELS))
+        recordEraserMode();
+
+      if (ImGui::Button("Reset")) {
+        recordEvent(SESSION_RESET, 0, 0, 0, 0, 0);
+        dispatchReset(this->window);
+      }
 
       ImGui::Text("Application average %.3f ms/frame (%.1f FPS)",
                   1000.0f / io.Framerate, io.Framerate);
@@ -203,10 +529,40 @@ void GLFWWindowManager::render() {
       ImGui::End();
     }
 
-    ImGui::Render();
-    ImGui_ImplOpenGL3_RenderDrawData(ImGui::GetDrawData());
+    if (isProfilerOpen)
+      this->profiler.drawPanel(&isProfilerOpen);
 
+    ImGui::Render();
+    ImDrawData *drawData = ImGui::GetDrawData();
+    this->profiler.endStage(STAGE_GUI_BUILD);
+
+    // the toolbar is drawn over the canvas, so both where it was and where
+    // it is now have to be repainted
+    ImVec4 bounds = guiBounds(drawData);
+    drawingManager->addDamage(bounds.x, bounds.y, bounds.z, bounds.w);
+    drawingManager->addDamage(lastGuiBounds.x, lastGuiBounds.y,
+                              lastGuiBounds.z, lastGuiBounds.w);
+    lastGuiBounds = bounds;
+
+    this->profiler.beginStage(STAGE_DISPLAY);
+    drawingManager->display(queryBufferAge());
+    this->profiler.endStage(STAGE_DISPLAY);
+
+    this->profiler.beginStage(STAGE_GUI_RENDER);
+    ImGui_ImplOpenGL3_RenderDrawData(drawData);
+    this->profiler.endStage(STAGE_GUI_RENDER);
+
+    this->profiler.beginStage(STAGE_SWAP);
     glfwSwapBuffers(window);
+    this->profiler.endStage(STAGE_SWAP);
+    this->profiler.endFrame();
+
+    pendingFrames = std::max(0, pendingFrames - 1);
+    this->measureFrame(frameStart);
+
     glfwPollEvents();
   }
+
+  if (this->replay)
+    this->reportReplay();
 }
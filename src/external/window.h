@@ -2,7 +2,12 @@
 #pragma once
 
 #include "drawing.h"
+#include "histogram.h"
+#include "input.h"
+#include "profiler.h"
+#include "session_recording.h"
 #include <GLFW/glfw3.h>
+#include <vector>
 
 class IWindowManager {
 public:
@@ -10,6 +15,11 @@ public:
   virtual void cleanUp() = 0;
   virtual void setUpListeners() = 0;
   virtual void render() = 0;
+  virtual void attachInput(InputQueue *queue) = 0;
+  virtual void wake() = 0;
+
+  virtual void recordSession(const char *path) = 0;
+  virtual void replaySession(const char *path, bool isRealtime) = 0;
 
   int width;
   int height;
@@ -20,11 +30,32 @@ private:
   GLFWwindow *window;
   const char *title = "Ipen";
 
+  SessionReader *replay = NULL;
+  bool isReplayRealtime = true;
+  SessionEvent nextEvent;
+  bool hasNextEvent = false;
+  uint64_t replayStart = 0;
+  uint64_t replayClock = 0; // recording time played, as fast as possible
+  std::vector<uint64_t> frameEvents; // when each event of the frame was due
+  LatencyHistogram eventLatency;
+  LatencyHistogram frameTimes;
+
+  FrameProfiler profiler;
+
+  void replayEvents();
+  void waitEvents();
+  void measureFrame(uint64_t frameStart);
+  void reportReplay();
+
 public:
   GLFWWindowManager();
 
   void createWindow(IDrawingManager *pointer);
   void setUpListeners();
   void render();
+  void attachInput(InputQueue *queue);
+  void wake();
+  void recordSession(const char *path);
+  void replaySession(const char *path, bool isRealtime);
   void cleanUp();
 };
@@ -0,0 +1,84 @@
+// Copyright (c) 2024 DavidDeadly
+#include "worker_pool.h"
+
+WorkerPool::WorkerPool(unsigned threads) {
+  for (unsigned i = 0; i < threads; i++)
+    this->workers.push_back(new std::thread([this]() { this->work(); }));
+}
+
+WorkerPool::~WorkerPool() {
+  {
+    std::lock_guard<std::mutex> guard(this->lock);
+    this->running = false;
+  }
+  this->wakeUp.notify_all();
+
+  for (auto worker : this->workers) {
+    worker->join();
+    delete worker;
+  }
+}
+
+void WorkerPool::runIterations(const std::function<void(size_t)> &task,
+                               size_t size) {
+  for (size_t i = this->next++; i < size; i = this->next++)
+    task(i);
+}
+
+// A worker counts as busy before it claims an iteration, so once none is
+// busy and every iteration is claimed the loop is done
+void WorkerPool::work() {
+  uint64_t seen = 0;
+
+  std::unique_lock<std::mutex> guard(this->lock);
+  while (true) {
+    this->wakeUp.wait(guard, [this, seen]() {
+      return this->generation != seen || !this->running;
+    });
+
+    if (!this->running)
+      break;
+
+    seen = this->generation;
+    if (!this->task)
+      continue; // woke up after the loop was done
+
+    const std::function<void(size_t)> *task = this->task;
+    size_t size = this->taskSize;
+    this->busy++;
+    guard.unlock();
+
+    this->runIterations(*task, size);
+
+    guard.lock();
+    this->busy--;
+    if (this->busy == 0)
+      this->finished.notify_all();
+  }
+}
+
+void WorkerPool::run(size_t size, const std::function<void(size_t)> &task) {
+  if (this->workers.empty() || size < 2) {
+    for (size_t i = 0; i < size; i++)
+      task(i);
+    return;
+  }
+
+  {
+    // a worker waking up late for the last loop is let go first
+    std::unique_lock<std::mutex> guard(this->lock);
+    this->finished.wait(guard, [this]() { return this->busy == 0; });
+
+    this->task = &task;
+    this->taskSize = size;
+    this->next = 0;
+    this->generation++;
+  }
+  this->wakeUp.notify_all();
+
+  this->runIterations(task, size);
+
+  std::unique_lock<std::mutex> guard(this->lock);
+  this->finished.wait(guard, [this]() { return this->busy == 0; });
+  this->task = nullptr;
+}
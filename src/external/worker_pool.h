@@ -0,0 +1,41 @@
+// Copyright (c) 2024 DavidDeadly
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Threads kept around to run the iterations of a loop in parallel. The
+// caller works through them too, so a pool without threads just runs the
+// loop.
+class WorkerPool {
+private:
+  std::vector<std::thread *> workers;
+
+  std::mutex lock;
+  std::condition_variable wakeUp;
+  std::condition_variable finished;
+  bool running = true;
+
+  const std::function<void(size_t)> *task = nullptr;
+  size_t taskSize = 0;
+  uint64_t generation = 0;
+  std::atomic<size_t> next = 0;
+  size_t busy = 0;
+
+  void work();
+  void runIterations(const std::function<void(size_t)> &task, size_t size);
+
+public:
+  WorkerPool(unsigned threads);
+  ~WorkerPool();
+
+  size_t threadCount() { return this->workers.size(); }
+  // returns once every iteration is done
+  void run(size_t size, const std::function<void(size_t)> &task);
+};
@@ -6,16 +6,41 @@ Ipen::Ipen(IWindowManager *wm, IDrawingManager *dm) {
   this->dm = dm;
 }
 
+void Ipen::addInputSource(IInputSource *source) {
+  this->inputs.push_back(new InputThread(source));
+}
+
+void Ipen::keepDrawing(const char *path) { this->drawingPath = path; }
+
 void Ipen::start() {
   this->wm->createWindow(this->dm);
   this->wm->setUpListeners();
 
   this->dm->init(this->wm->width, this->wm->height);
+  // whatever a crash kept out of the drawing is replayed from its journal
+  if (this->drawingPath) {
+    this->dm->loadDrawing(this->drawingPath);
+    this->dm->openJournal(this->drawingPath);
+  }
+
+  IWindowManager *wm = this->wm;
+  for (auto input : this->inputs) {
+    wm->attachInput(&input->queue);
+    input->start(wm->width, wm->height, [wm]() { wm->wake(); });
+  }
 
   this->wm->render();
 }
 
 void Ipen::end() {
+  for (auto input : this->inputs)
+    delete input;
+
+  this->inputs.clear();
+
+  if (this->drawingPath)
+    this->dm->saveDrawing(this->drawingPath);
+
   this->wm->cleanUp();
   this->dm->cleanUp();
 }
@@ -1,17 +1,26 @@
 // Copyright (c) 2024 DavidDeadly
 #pragma once
 
+#include <vector>
+
 #include "external/drawing.h"
+#include "external/input.h"
 #include "external/window.h"
 
 class Ipen {
 private:
   IWindowManager *wm;
   IDrawingManager *dm;
+  std::vector<InputThread *> inputs;
+  const char *drawingPath = NULL;
 
 public:
   Ipen(IWindowManager *wm, IDrawingManager *dm);
 
+  void addInputSource(IInputSource *source);
+  // loaded on start, if it exists, and saved on exit
+  void keepDrawing(const char *path);
+
   void start();
   void end();
 };
@@ -1,15 +1,81 @@
 // Copyright (c) 2024 DavidDeadly
+#include <atomic>
+#include <csignal>
+#include <cstring>
+#include <iostream>
+
 #include "external/drawing.h"
+#include "external/evdev_replay.h"
+#include "external/script_source.h"
 #include "external/window.h"
+#ifdef IPEN_LIBINPUT
+#include "external/libinput_source.h"
+#endif
 
 #include "./ipen.h"
 
-int main() {
+static std::atomic<bool> isRecording = true;
+
+static void printUsage() {
+  std::cout << "Usage: ipen [--drawing <drawing>]" << std::endl
+            << "       ipen [--replay-evdev <recording>]" << std::endl
+            << "       ipen [--script <script>]" << std::endl
+            << "       ipen [--record-session <recording>]" << std::endl
+            << "       ipen [--replay-session <recording> [--fast]]"
+            << std::endl
+            << "       ipen --record-evdev <device> <recording>" << std::endl;
+}
+
+int main(int argc, char **argv) {
+  bool isRecordMode = argc == 4 && strcmp(argv[1], "--record-evdev") == 0;
+  if (isRecordMode) {
+    std::signal(SIGINT, [](int) { isRecording = false; });
+    std::cout << "Recording " << argv[2] << ", Ctrl+C to stop" << std::endl;
+
+    return recordEvdev(argv[2], argv[3], isRecording) ? 0 : 1;
+  }
+
+  bool isReplayMode = argc == 3 && strcmp(argv[1], "--replay-evdev") == 0;
+  bool isScriptMode = argc == 3 && strcmp(argv[1], "--script") == 0;
+  bool isDrawingMode = argc == 3 && strcmp(argv[1], "--drawing") == 0;
+  bool isSessionRecordMode =
+      argc == 3 && strcmp(argv[1], "--record-session") == 0;
+  bool isSessionReplayMode =
+      (argc == 3 || argc == 4) && strcmp(argv[1], "--replay-session") == 0;
+  bool isFastReplay = argc == 4 && strcmp(argv[3], "--fast") == 0;
+
+  bool isKnownMode = isReplayMode || isScriptMode || isDrawingMode ||
+                     isSessionRecordMode ||
+                     (isSessionReplayMode && (argc == 3 || isFastReplay));
+  if (argc > 1 && !isKnownMode) {
+    printUsage();
+    return 1;
+  }
+
   IWindowManager *windowService = new GLFWWindowManager();
   IDrawingManager *drawingService = new SkiaManager();
 
   Ipen *ipen = new Ipen(windowService, drawingService);
 
+  if (isDrawingMode)
+    ipen->keepDrawing(argv[2]);
+
+  if (isSessionRecordMode)
+    windowService->recordSession(argv[2]);
+
+  if (isSessionReplayMode)
+    windowService->replaySession(argv[2], !isFastReplay);
+
+  if (isReplayMode)
+    ipen->addInputSource(new EvdevReplaySource(argv[2], true));
+
+  if (isScriptMode)
+    ipen->addInputSource(new ScriptSource(argv[2], true));
+
+#ifdef IPEN_LIBINPUT
+  ipen->addInputSource(new LibinputSource());
+#endif
+
   ipen->start();
   ipen->end();
 }
@@ -0,0 +1,310 @@
+// Copyright (c) 2024 DavidDeadly
+//
+// Runs an input script or a tablet recording through SkiaManager on the CPU
+// raster backend, with no window or GPU, then reports the time spent per
+// frame and writes or checks the resulting image.
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+#define STB_IMAGE_IMPLEMENTATION
+#include "stb_image.h"
+
+#include "include/core/SkImage.h"
+#include "include/core/SkImageInfo.h"
+#include "include/core/SkPixmap.h"
+#include "include/core/SkStream.h"
+#include "include/encode/SkPngEncoder.h"
+
+#include "drawing.h"
+#include "evdev_replay.h"
+#include "log.h"
+#include "script_source.h"
+
+const int PIXEL_TOLERANCE = 1; // per channel, for rounding differences
+
+static void printUsage() {
+  std::cout << "Usage: ipen_headless <script> [--size <width> <height>]"
+            << std::endl
+            << "       ipen_headless --replay-evdev <recording> [...]"
+            << std::endl
+            << "         [--out <image.png>] [--compare <image.png>]"
+            << std::endl
+            << "         [--tolerance <px>]"
+            << " [--eraser strokes|segments|pixels]" << std::endl
+            << "         [--recover <drawing>]" << std::endl;
+}
+
+static double elapsedMs(std::chrono::steady_clock::time_point since) {
+  auto elapsed = std::chrono::steady_clock::now() - since;
+  return std::chrono::duration<double, std::milli>(elapsed).count();
+}
+
+static bool writePng(sk_sp<SkImage> image, const char *path) {
+  SkPixmap pixmap;
+  SkFILEWStream file(path);
+
+  bool isWritten = file.isValid() && image->peekPixels(&pixmap) &&
+                   SkPngEncoder::Encode(&file, pixmap, {});
+  if (!isWritten)
+    std::cerr << "Failed to write image: " << path << std::endl;
+
+  return isWritten;
+}
+
+static std::vector<unsigned char> readRgba(sk_sp<SkImage> image) {
+  SkImageInfo info =
+      SkImageInfo::Make(image->width(), image->height(),
+                        kRGBA_8888_SkColorType, kUnpremul_SkAlphaType);
+  std::vector<unsigned char> pixels(info.computeMinByteSize());
+  image->readPixels(nullptr, info, pixels.data(), info.minRowBytes(), 0, 0);
+
+  return pixels;
+}
+
+static long countDifferences(const std::vector<unsigned char> &pixels,
+                             const unsigned char *reference) {
+  long differences = 0;
+  for (size_t pixel = 0; pixel < pixels.size(); pixel += 4) {
+    for (int channel = 0; channel < 4; channel++) {
+      int delta = pixels[pixel + channel] - reference[pixel + channel];
+      if (std::abs(delta) > PIXEL_TOLERANCE) {
+        differences++;
+        break;
+      }
+    }
+  }
+
+  return differences;
+}
+
+// Counts the pixels differing from a reference image, -1 if it can't be used
+static long comparePng(sk_sp<SkImage> image, const char *path) {
+  int width, height;
+  unsigned char *reference = stbi_load(path, &width, &height, NULL, 4);
+  if (!reference) {
+    std::cerr << "Failed to load reference: " << stbi_failure_reason()
+              << std::endl;
+    return -1;
+  }
+
+  if (width != image->width() || height != image->height()) {
+    std::cerr << "Reference is " << width << "x" << height << std::endl;
+    stbi_image_free(reference);
+    return -1;
+  }
+
+  long differences = countDifferences(readRgba(image), reference);
+
+  stbi_image_free(reference);
+  return differences;
+}
+
+// Opens the drawing and its journal like ipen does after a crash and
+// counts the pixels differing from what the session showed, -1 if it
+// can't be opened
+static long compareRecovered(sk_sp<SkImage> image, const char *drawingPath,
+                             float tolerance) {
+  SkiaManager recovered;
+  recovered.initRaster(image->width(), image->height());
+  if (tolerance >= 0)
+    recovered.setSimplifyTolerance(tolerance);
+
+  recovered.loadDrawing(drawingPath);
+  if (!recovered.openJournal(drawingPath)) {
+    std::cerr << "Failed to open the journal of: " << drawingPath
+              << std::endl;
+    recovered.cleanUp();
+    return -1;
+  }
+
+  // the drawing loads a block per frame, then the journal is replayed
+  recovered.display(1);
+  while (recovered.needsRedraw())
+    recovered.display(1);
+
+  long differences =
+      countDifferences(readRgba(recovered.snapshot()),
+                       readRgba(image).data());
+  recovered.cleanUp();
+
+  return differences;
+}
+
+int main(int argc, char **argv) {
+  bool isEvdevReplay = argc > 1 && strcmp(argv[1], "--replay-evdev") == 0;
+  int firstOption = isEvdevReplay ? 3 : 2;
+  if (argc < firstOption) {
+    printUsage();
+    return 1;
+  }
+  const char *inputPath = argv[firstOption - 1];
+
+  int width = 1920;
+  int height = 1080;
+  const char *outPath = NULL;
+  const char *comparePath = NULL;
+  float tolerance = -1;
+  EraserMode eraserMode = ERASER_STROKES;
+  const char *recoverPath = NULL;
+
+  for (int i = firstOption; i < argc; i++) {
+    if (strcmp(argv[i], "--size") == 0 && i + 2 < argc) {
+      width = atoi(argv[++i]);
+      height = atoi(argv[++i]);
+    } else if (strcmp(argv[i], "--out") == 0 && i + 1 < argc) {
+      outPath = argv[++i];
+    } else if (strcmp(argv[i], "--compare") == 0 && i + 1 < argc) {
+      comparePath = argv[++i];
+    } else if (strcmp(argv[i], "--tolerance") == 0 && i + 1 < argc) {
+      tolerance = atof(argv[++i]);
+    } else if (strcmp(argv[i], "--recover") == 0 && i + 1 < argc) {
+      recoverPath = argv[++i];
+    } else if (strcmp(argv[i], "--eraser") == 0 && i + 1 < argc) {
+      const char *mode = argv[++i];
+      if (strcmp(mode, "segments") == 0) {
+        eraserMode = ERASER_SEGMENTS;
+      } else if (strcmp(mode, "pixels") == 0) {
+        eraserMode = ERASER_PIXELS;
+      } else if (strcmp(mode, "strokes") != 0) {
+        printUsage();
+        return 1;
+      }
+    } else {
+      printUsage();
+      return 1;
+    }
+  }
+
+  SkiaManager drawingManager;
+  drawingManager.initRaster(width, height);
+  if (tolerance >= 0)
+    drawingManager.setSimplifyTolerance(tolerance);
+  drawingManager.setEraserMode(eraserMode);
+
+  // journaled from scratch, compacted whenever it can be and drawn in a
+  // color snapshots don't keep
+  if (recoverPath) {
+    std::string journalPath = std::string(recoverPath) + ".journal";
+    std::remove(recoverPath);
+    std::remove(journalPath.c_str());
+
+    if (!drawingManager.openJournal(recoverPath)) {
+      std::cerr << "Failed to open the journal of: " << recoverPath
+                << std::endl;
+      drawingManager.cleanUp();
+      return 1;
+    }
+    drawingManager.setJournalCompaction(1);
+
+    float rgba[4];
+    drawingManager.changeColor(rgba, RED);
+  }
+
+  // recordings play a frame interval of reports per frame, as fast as
+  // possible
+  ScriptSource *script = NULL;
+  EvdevReplaySource *recording = NULL;
+  auto openInput = [&]() {
+    delete script;
+    delete recording;
+    script = NULL;
+    recording = NULL;
+
+    if (isEvdevReplay) {
+      recording = new EvdevReplaySource(inputPath, false);
+      recording->setArea(width, height);
+    } else {
+      script = new ScriptSource(inputPath, false);
+      script->setArea(width, height);
+    }
+  };
+  auto nextFrame = [&](InputQueue &queue) {
+    return recording ? recording->nextFrame(queue) : script->nextFrame(queue);
+  };
+
+  InputQueue *queue = new InputQueue();
+
+  int frames = 0;
+  double inputMs = 0;
+  double displayMs = 0;
+  double slowestFrameMs = 0;
+
+  auto playInput = [&]() {
+    openInput();
+
+    while (nextFrame(*queue)) {
+      auto frameStart = std::chrono::steady_clock::now();
+      drawingManager.processInput(*queue);
+      double frameInputMs = elapsedMs(frameStart);
+
+      auto displayStart = std::chrono::steady_clock::now();
+      // the raster surface keeps its pixels, like a back buffer of age 1
+      drawingManager.display(1);
+      double frameDisplayMs = elapsedMs(displayStart);
+
+      frames++;
+      inputMs += frameInputMs;
+      displayMs += frameDisplayMs;
+      slowestFrameMs =
+          std::max(slowestFrameMs, frameInputMs + frameDisplayMs);
+    }
+  };
+
+  playInput();
+
+  // an undo right after a compaction has to do on recovery what it did
+  // here, and the input played again is left in the journal so recovering
+  // replays it over the snapshot
+  if (recoverPath) {
+    drawingManager.reset();
+    drawingManager.processInput(*queue);
+    drawingManager.undo();
+
+    drawingManager.setJournalCompaction(JOURNAL_COMPACT_RECORDS);
+    playInput();
+  }
+
+  flushLog();
+  std::cout << "Frames: " << frames << std::endl
+            << "Input: " << inputMs << " ms, display: " << displayMs << " ms"
+            << std::endl;
+  if (frames > 0)
+    std::cout << "Average frame: " << (inputMs + displayMs) / frames
+              << " ms, slowest: " << slowestFrameMs << " ms" << std::endl;
+  std::cout << "Stored points: " << drawingManager.pointCount() << std::endl;
+
+  sk_sp<SkImage> image = drawingManager.snapshot();
+  int status = 0;
+
+  if (outPath && !writePng(image, outPath))
+    status = 1;
+
+  if (comparePath) {
+    long differences = comparePng(image, comparePath);
+    std::cout << "Differing pixels: " << differences << std::endl;
+
+    if (differences != 0)
+      status = 1;
+  }
+
+  delete queue;
+  delete script;
+  delete recording;
+  // left unsaved as a crash would, only the journal's writes are waited for
+  drawingManager.cleanUp();
+
+  if (recoverPath) {
+    long differences = compareRecovered(image, recoverPath, tolerance);
+    std::cout << "Recovered differing pixels: " << differences << std::endl;
+
+    if (differences != 0)
+      status = 1;
+  }
+
+  return status;
+}